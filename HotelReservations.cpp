@@ -5,263 +5,4835 @@
 #include <tuple>
 #include <queue>
 #include <bitset>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <set>
+#include <functional>
+#include <random>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 /**
- * @class Hotel
- * @brief Manages hotel room bookings using multiple algorithms for comparison.
+ * @brief Returns the index of the lowest set bit of a non-zero word.
+ */
+inline int LowestSetBit(std::uint64_t word)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+/**
+ * @brief Returns the index of the highest set bit of a non-zero word.
+ */
+inline int HighestSetBit(std::uint64_t word)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, word);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(word);
+#endif
+}
+
+/**
+ * @brief Returns the number of set bits in a word.
+ */
+inline int PopCount(std::uint64_t word)
+{
+    return static_cast<int>(std::bitset<64>(word).count());
+}
+
+/**
+ * @brief Transposes a 64x64 bit matrix in place: bit j of row i moves to bit i of row j.
  *
- * Supports three booking strategies:
- *   - Book: Brute-force approach using a 2D vector.
- *   - Book_V2: Heap-based approach using a 2D vector.
- *   - Book_V3: Bitset + utilization array + heap for optimal performance.
+ * Swaps ever smaller off-diagonal blocks (32, 16, ..., 1 bits), 6 rounds of 32 word operations.
  */
-class Hotel
+inline void Transpose64(std::uint64_t rows[64])
 {
-private:
-    int size; ///< Number of rooms in the hotel
-    static const int MaxDays = 366; ///< Maximum number of days (0-based, e.g., 0-365)
-    /**
-     * @brief Occupancy tracking for Book and Book_V2 (brute-force/heap-based)
-     * occupied_bf[room][day] == true if room is booked on that day
-     */
-    std::vector<std::vector<bool>> occupied_bf;
-    using Bitset = std::bitset<MaxDays>;
-    /**
-     * @brief Occupancy tracking for Book_V3 (bitset-based)
-     * occupied_bs[room].test(day) == true if room is booked on that day
-     */
-    std::vector<Bitset> occupied_bs;
+    std::uint64_t mask = 0x00000000FFFFFFFFULL;
+    for (int j = 32; j != 0; j >>= 1, mask ^= (mask << j))
+    {
+        for (int k = 0; k < 64; k = ((k | j) + 1) & ~j)
+        {
+            const std::uint64_t swap = ((rows[k] >> j) ^ rows[k | j]) & mask;
+            rows[k] ^= swap << j;
+            rows[k | j] ^= swap;
+        }
+    }
+}
+
+/**
+ * @class PagedArray
+ * @brief Array of elements stored in fixed-size pages shared copy-on-write between owners.
+ *
+ * Copying a PagedArray is O(1): the page directory is shared, and a directory or page is only
+ * duplicated when an owner writes to it while another owner still refers to it. Reads go through
+ * operator[]; writes must go through mut(), which performs the copy-on-write check.
+ */
+template <typename T>
+class PagedArray
+{
+public:
+    static const int PageSize = 64; ///< Elements per page
+
+    PagedArray() : count(0), dir(std::make_shared<Directory>()) {}
+
     /**
-     * @brief Utilization array for Book_V3 (number of booked days per room)
+     * @brief Constructs an array of n copies of value.
+     * @param n Number of elements
+     * @param value Initial value
      */
-    std::vector<int> utilization;
+    PagedArray(int n, const T &value) : PagedArray()
+    {
+        resize(n, value);
+    }
 
     /**
-     * @brief Counts the number of booked days for a room (brute-force/heap-based)
-     * @param room Room index
-     * @return Number of days the room is booked
+     * @brief Returns the number of elements.
      */
-    int countUtilization_bf(int room) const
+    int size() const
     {
-        int count = 0;
-        for (int d = 0; d < MaxDays; ++d)
-        {
-            if (occupied_bf[room][d])
-                ++count;
-        }
         return count;
     }
+
     /**
-     * @brief Returns the number of booked days for a room (bitset-based)
-     * @param room Room index
-     * @return Number of days the room is booked
+     * @brief Read-only access to element i.
      */
-    int countUtilization_bs(int room) const
+    const T &operator[](int i) const
     {
-        return utilization[room];
+        return (*(*dir)[i / PageSize])[i % PageSize];
     }
 
-public:
     /**
-     * @brief Constructs a Hotel with the given number of rooms.
-     * @param s Number of rooms
+     * @brief Writable access to element i, copying the directory and page first if they are shared.
      */
-    Hotel(int s)
-        : size(s),
-          occupied_bf(s, std::vector<bool>(MaxDays, false)),
-          occupied_bs(s, Bitset()),
-          utilization(s, 0) {}
+    T &mut(int i)
+    {
+        if (dir.use_count() > 1)
+            dir = std::make_shared<Directory>(*dir);
+        std::shared_ptr<Page> &page = (*dir)[i / PageSize];
+        if (page.use_count() > 1)
+            page = std::make_shared<Page>(*page);
+        // Pairs with the release in another owner's reference drop before we write in place
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return (*page)[i % PageSize];
+    }
 
     /**
-     * @brief Brute-force booking: finds the most utilized available room for the requested period.
+     * @brief Returns true if element i lies on the same page object in both arrays.
      *
-     * @param start Start day (inclusive)
-     * @param end End day (inclusive)
-     * @return "Accept" if booking is successful, "Decline" otherwise
+     * Copies share every page until one side writes it, so this tells whether the page holding
+     * element i has been written by either side since the copy.
      */
-
-    std::string Book(int start, int end)
+    bool SharesPage(const PagedArray &other, int i) const
     {
-        if (start < 0 || end >= MaxDays || start > end)
-        {
-            return "Decline";
-        }
+        return i < count && i < other.count && (*dir)[i / PageSize] == (*other.dir)[i / PageSize];
+    }
 
-        // Find all free rooms for the period
-        std::vector<int> freeRooms;
-        for (int r = 0; r < size; ++r)
+    /**
+     * @brief Grows the array to n elements, initializing new elements to value.
+     * @param n New number of elements (must not be smaller than size())
+     * @param value Value for the new elements
+     */
+    void resize(int n, const T &value)
+    {
+        while (count < n)
         {
-            bool isFree = true;
-            for (int d = start; d <= end; ++d)
-            {
-                if (occupied_bf[r][d])
-                {
-                    isFree = false;
-                    break;
-                }
-            }
-            if (isFree)
+            if (count % PageSize == 0)
             {
-                freeRooms.push_back(r);
+                if (dir.use_count() > 1)
+                    dir = std::make_shared<Directory>(*dir);
+                dir->push_back(std::make_shared<Page>());
             }
+            mut(count) = value;
+            ++count; // Only once the element is written, so a failed page copy leaves the size unchanged
         }
+    }
 
-        if (freeRooms.empty())
-        {
-            return "Decline";
-        }
+private:
+    using Page = std::array<T, PageSize>;
+    using Directory = std::vector<std::shared_ptr<Page>>;
 
-        // Assign to the most utilized room (leave less utilized rooms for future stays)
-        // In case of ties, choose the lowest room number
-        int maxOccupiedCount = -1;
-        int chosenRoom = -1;
-        for (int r : freeRooms)
-        {
-            int count = countUtilization_bf(r);
-            if (count > maxOccupiedCount || (count == maxOccupiedCount && (chosenRoom == -1 || r < chosenRoom)))
-            {
-                maxOccupiedCount = count;
-                chosenRoom = r;
-            }
-        }
+    int count; ///< Number of elements in use
+    std::shared_ptr<Directory> dir; ///< Page directory, shared between copies until written
+};
 
-        // Assign the booking to the chosen room
-        for (int d = start; d <= end; ++d)
-        {
-            occupied_bf[chosenRoom][d] = true;
-        }
+/**
+ * @name Room-selection policies
+ * Compile-time rules plugged into the booking engines (Book, Book_V2, Book_V3, BookBatch) as a
+ * template parameter. Among the free rooms, the engine picks the highest Score(); ties go to the
+ * lowest room number. UsesGap tells the engine whether to compute the free gap around the stay,
+ * and TakeFirst lets it stop at the first free room.
+ * @{
+ */
 
-        return "Accept";
-    }
+/**
+ * @brief Most booked days first, leaving less utilized rooms open for longer stays (default).
+ */
+struct MostUtilizedPolicy
+{
+    static const bool UsesGap = false;
+    static const bool TakeFirst = false;
+    static const char *Name() { return "MostUtilized"; }
+    static int Score(int utilization, int /*gap*/) { return utilization; }
+};
 
-    /**
-     * @brief Heap-based booking: selects the most utilized available room using a max-heap.
-     *
-     * @param start Start day (inclusive)
-     * @param end End day (inclusive)
-     * @return "Accept" if booking is successful, "Decline" otherwise
-     */
-    std::string Book_V2(int start, int end)
-    {
-        if (start < 0 || end >= MaxDays || start > end)
-        {
-            return "Decline";
-        }
+/**
+ * @brief Fewest booked days first, spreading bookings across rooms.
+ */
+struct LeastUtilizedPolicy
+{
+    static const bool UsesGap = false;
+    static const bool TakeFirst = false;
+    static const char *Name() { return "LeastUtilized"; }
+    static int Score(int utilization, int /*gap*/) { return -utilization; }
+};
 
-        // Find all free rooms for the period
-        std::vector<int> freeRooms;
-        for (int r = 0; r < size; ++r)
-        {
-            bool isFree = true;
-            for (int d = start; d <= end; ++d)
-            {
-                if (occupied_bf[r][d])
-                {
-                    isFree = false;
-                    break;
-                }
-            }
-            if (isFree)
-            {
-                freeRooms.push_back(r);
-            }
-        }
+/**
+ * @brief Smallest free gap left around the stay, reducing calendar fragmentation.
+ */
+struct BestFitGapPolicy
+{
+    static const bool UsesGap = true;
+    static const bool TakeFirst = false;
+    static const char *Name() { return "BestFitGap"; }
+    static int Score(int /*utilization*/, int gap) { return -gap; }
+};
 
-        if (freeRooms.empty())
-        {
-            return "Decline";
-        }
+/**
+ * @brief Lowest-numbered free room.
+ */
+struct FirstFitPolicy
+{
+    static const bool UsesGap = false;
+    static const bool TakeFirst = true;
+    static const char *Name() { return "FirstFit"; }
+    static int Score(int /*utilization*/, int /*gap*/) { return 0; }
+};
 
-        // Use a max-heap to select the most utilized room (lowest room number in case of tie)
-        using RoomInfo = std::pair<int, int>; // (utilization, -room number)
-        std::priority_queue<RoomInfo> pq;
-        for (int r : freeRooms)
-        {
-            pq.push({countUtilization_bf(r), -r});
-        }
-        int chosenRoom = -pq.top().second;
+/** @} */
 
-        // Assign the booking to the chosen room
-        for (int d = start; d <= end; ++d)
-        {
-            occupied_bf[chosenRoom][d] = true;
-        }
-        return "Accept";
+/**
+ * @class TimerWheel
+ * @brief Hierarchical timer wheel over a logical clock measured in ticks.
+ *
+ * Four levels of 64 slots cover 2^24 ticks ahead; later timers wait in the last top-level slot
+ * and are re-placed when it comes up. Scheduling is O(1), and each timer is moved down at most
+ * once per level before it fires, so expiring many timers never scans the pending set.
+ * Cancellation is left to the callback, which should ignore ids that are no longer pending.
+ * Each level is one page of a PagedArray, so copying a wheel is O(1) and a copy duplicates a
+ * level only when it next places or fires a timer there.
+ */
+class TimerWheel
+{
+public:
+    static const int Levels = 4;   ///< Number of wheel levels
+    static const int SlotBits = 6; ///< log2 of the slots per level
+    static const int Slots = 1 << SlotBits;
+
+    TimerWheel() : now(0), wheel(Levels * Slots, std::vector<Timer>()) {}
+
+    /**
+     * @brief Returns the current tick.
+     */
+    std::uint64_t Now() const
+    {
+        return now;
     }
+
     /**
-     * @brief Bitset + heap + utilization array: most optimal booking approach.
-     *
-     * Uses bitsets for fast occupancy checks, a utilization array for O(1) lookup, and a heap for efficient selection.
-     *
-     * @param start Start day (inclusive)
-     * @param end End day (inclusive)
-     * @return "Accept" if booking is successful, "Decline" otherwise
+     * @brief Schedules a timer.
+     * @param id Caller's id, passed back on expiry
+     * @param expiry Tick at which the timer fires (at least the next tick)
      */
-    std::string Book_V3(int start, int end)
+    void Schedule(int id, std::uint64_t expiry)
     {
-        if (start < 0 || end >= MaxDays || start > end)
-            return "Decline";
+        place({id, std::max(expiry, now + 1)});
+    }
 
-        std::vector<int> freeRooms;
-        for (int r = 0; r < size; ++r)
+    /**
+     * @brief Advances the clock, firing every timer that expires on the way.
+     * @param to Tick to advance to
+     * @param onExpire Called with the id of each expired timer, in expiry order
+     */
+    template <typename Callback>
+    void Advance(std::uint64_t to, Callback onExpire)
+    {
+        while (now < to)
         {
-            bool isFree = true;
-            for (int d = start; d <= end; ++d)
+            ++now;
+            // Move the timers of every higher-level slot that starts at this tick one level down
+            for (int level = 1; level < Levels; ++level)
             {
-                if (occupied_bs[r].test(d))
-                {
-                    isFree = false;
+                if ((now & ((1ULL << (SlotBits * level)) - 1)) != 0)
                     break;
-                }
+                const int slot = level * Slots + static_cast<int>((now >> (SlotBits * level)) & (Slots - 1));
+                if (wheel[slot].empty())
+                    continue;
+                std::vector<Timer> cascading;
+                cascading.swap(wheel.mut(slot));
+                for (const Timer &timer : cascading)
+                    place(timer);
             }
-            if (isFree)
-                freeRooms.push_back(r);
+            const int slot = static_cast<int>(now & (Slots - 1));
+            if (wheel[slot].empty())
+                continue;
+            std::vector<Timer> due;
+            due.swap(wheel.mut(slot));
+            for (const Timer &timer : due)
+                onExpire(timer.id);
         }
-        if (freeRooms.empty())
-            return "Decline";
+    }
 
-        // Use a max-heap to select the most utilized room (lowest room number in case of tie)
-        using RoomInfo = std::pair<int, int>; // (utilization, -room number)
-        std::priority_queue<RoomInfo> pq;
-        for (int r : freeRooms)
+    /**
+     * @brief Lists the pending timers, for consistency checks. O(pending timers).
+     * @return (id, expiry) of every timer that has not fired, sorted
+     */
+    std::vector<std::pair<int, std::uint64_t>> Pending() const
+    {
+        std::vector<std::pair<int, std::uint64_t>> pending;
+        for (int slot = 0; slot < wheel.size(); ++slot)
         {
-            pq.push({utilization[r], -r});
+            for (const Timer &timer : wheel[slot])
+                pending.push_back({timer.id, timer.expiry});
         }
-        int chosenRoom = -pq.top().second;
+        std::sort(pending.begin(), pending.end());
+        return pending;
+    }
 
-        // Assign the booking
-        for (int d = start; d <= end; ++d)
-        {
-            occupied_bs[chosenRoom].set(d);
-        }
-        utilization[chosenRoom] += (end - start + 1);
-        return "Accept";
+private:
+    struct Timer
+    {
+        int id;
+        std::uint64_t expiry;
+    };
+
+    /**
+     * @brief Puts a timer in the lowest level whose span covers its remaining delay.
+     */
+    void place(const Timer &timer)
+    {
+        const std::uint64_t delay = timer.expiry - now;
+        int level = 0;
+        while (level < Levels - 1 && delay >= (1ULL << (SlotBits * (level + 1))))
+            ++level;
+        std::uint64_t slot = timer.expiry >> (SlotBits * level);
+        if (delay >= (1ULL << (SlotBits * Levels)))
+            slot = (now >> (SlotBits * level)) + Slots - 1; // Beyond the horizon: wait in the last slot
+        wheel.mut(level * Slots + static_cast<int>(slot & (Slots - 1))).push_back(timer);
     }
+
+    std::uint64_t now;                    ///< Current tick
+    PagedArray<std::vector<Timer>> wheel; ///< Levels * Slots timer lists, one page per level
 };
 
-void RunTest(const std::string &testName, int size, const std::vector<std::tuple<int, int, std::string>> &bookings)
+/**
+ * @class SpscQueue
+ * @brief Bounded lock-free queue for one producer thread and one consumer thread.
+ *
+ * A ring buffer with a power-of-two capacity; the producer only writes the tail and the consumer
+ * only writes the head, so neither side ever waits for the other.
+ */
+template <typename T>
+class SpscQueue
 {
-    std::cout << "Running " << testName << " (Size=" << size << ")" << std::endl;
-    Hotel hotel(size);
-    int bookingNum = 1;
-    bool passed = true;
-    for (const auto &booking : bookings)
+public:
+    /**
+     * @brief Constructs an empty queue.
+     * @param capacity Maximum number of queued items, rounded up to a power of two
+     */
+    explicit SpscQueue(std::size_t capacity)
+        : head(0), tail(0)
     {
-        int start = std::get<0>(booking);
-        int end = std::get<1>(booking);
-        std::string expected = std::get<2>(booking);
-        std::string result = hotel.Book_V3(start, end);
-        std::cout << "Booking " << bookingNum << ": " << start << "-" << end << " " << result << " (expected: " << expected << ")" << std::endl;
-        if (result != expected)
-        {
-            std::cout << "FAIL: Expected " << expected << " but got " << result << std::endl;
-            passed = false;
-        }
-        ++bookingNum;
+        std::size_t rounded = 1;
+        while (rounded < capacity)
+            rounded <<= 1;
+        items.resize(rounded);
+        mask = rounded - 1;
     }
-    if (passed)
+
+    /**
+     * @brief Appends an item (producer thread only).
+     * @return False if the queue is full and the item was not added
+     */
+    bool TryPush(const T &item)
     {
-        std::cout << "PASS" << std::endl;
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == items.size())
+            return false;
+        items[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest item (consumer thread only).
+     * @return False if the queue is empty
+     */
+    bool TryPop(T &item)
+    {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        item = items[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> items;           ///< Ring buffer storage
+    std::size_t mask;               ///< items.size() - 1
+    std::atomic<std::size_t> head;  ///< Next item to pop (written by the consumer)
+    std::atomic<std::size_t> tail;  ///< Next free slot (written by the producer)
+};
+
+/**
+ * @class IntervalIndex
+ * @brief Index of day intervals that finds every interval overlapping a query range.
+ *
+ * Intervals are bucketed by start day, and a segment tree over the start days keeps the latest
+ * end day in each subtree. A query descends only into subtrees that can reach the query's start,
+ * so it costs O(log days) per matching start day rather than a pass over all intervals.
+ */
+class IntervalIndex
+{
+public:
+    /**
+     * @brief Constructs an empty index over days [0, days).
+     * @param days Number of days in the domain
+     */
+    explicit IntervalIndex(int days)
+        : days(days), buckets(days), maxEnd(4 * days, -1) {}
+
+    /**
+     * @brief Adds an interval.
+     * @param id Caller's id (non-negative, not already in the index)
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     */
+    void Insert(int id, int start, int end)
+    {
+        if (id >= static_cast<int>(ranges.size()))
+            ranges.resize(id + 1, {-1, -1});
+        ranges[id] = {start, end};
+        buckets[start].push_back(id);
+        update(1, 0, days - 1, start);
+    }
+
+    /**
+     * @brief Removes an interval. Does nothing if the id is not in the index.
+     * @param id Caller's id
+     */
+    void Erase(int id)
+    {
+        if (id < 0 || id >= static_cast<int>(ranges.size()) || ranges[id].first < 0)
+            return;
+        const int start = ranges[id].first;
+        std::vector<int> &bucket = buckets[start];
+        bucket.erase(std::find(bucket.begin(), bucket.end(), id));
+        ranges[id] = {-1, -1};
+        update(1, 0, days - 1, start);
+    }
+
+    /**
+     * @brief Collects the ids of all intervals overlapping [start, end].
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @return Matching ids, in ascending order
+     */
+    std::vector<int> Overlapping(int start, int end) const
+    {
+        std::vector<int> ids;
+        collect(1, 0, days - 1, start, end, ids);
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    /**
+     * @brief Returns the interval stored for an id.
+     * @param id Caller's id
+     * @return (start, end), or (-1, -1) if the id is not in the index
+     */
+    std::pair<int, int> Range(int id) const
+    {
+        if (id < 0 || id >= static_cast<int>(ranges.size()))
+            return {-1, -1};
+        return ranges[id];
+    }
+
+    /**
+     * @brief Checks that the buckets, the ranges and the segment tree agree. O(days + intervals).
+     */
+    bool Consistent() const
+    {
+        std::size_t bucketed = 0;
+        for (int day = 0; day < days; ++day)
+        {
+            for (int id : buckets[day])
+            {
+                if (id < 0 || id >= static_cast<int>(ranges.size()) || ranges[id].first != day)
+                    return false;
+            }
+            bucketed += buckets[day].size();
+        }
+        std::size_t stored = 0;
+        for (const std::pair<int, int> &range : ranges)
+        {
+            if (range.first >= 0)
+                ++stored;
+        }
+        return bucketed == stored && latestEnd(1, 0, days - 1) != -2;
+    }
+
+private:
+    /**
+     * @brief Recomputes a subtree's latest end day, or returns -2 if the stored tree disagrees.
+     */
+    int latestEnd(int node, int lo, int hi) const
+    {
+        int latest = -1;
+        if (lo == hi)
+        {
+            for (int id : buckets[lo])
+                latest = std::max(latest, ranges[id].second);
+        }
+        else
+        {
+            int mid = (lo + hi) / 2;
+            int left = latestEnd(2 * node, lo, mid);
+            int right = latestEnd(2 * node + 1, mid + 1, hi);
+            if (left == -2 || right == -2)
+                return -2;
+            latest = std::max(left, right);
+        }
+        return maxEnd[node] == latest ? latest : -2;
+    }
+
+    /**
+     * @brief Recomputes the latest end day on the path to a start day's bucket.
+     */
+    void update(int node, int lo, int hi, int day)
+    {
+        if (lo == hi)
+        {
+            int latest = -1;
+            for (int id : buckets[day])
+                latest = std::max(latest, ranges[id].second);
+            maxEnd[node] = latest;
+            return;
+        }
+        int mid = (lo + hi) / 2;
+        if (day <= mid)
+            update(2 * node, lo, mid, day);
+        else
+            update(2 * node + 1, mid + 1, hi, day);
+        maxEnd[node] = std::max(maxEnd[2 * node], maxEnd[2 * node + 1]);
+    }
+
+    /**
+     * @brief Visits start days up to end whose intervals can reach start.
+     */
+    void collect(int node, int lo, int hi, int start, int end, std::vector<int> &ids) const
+    {
+        if (lo > end || maxEnd[node] < start)
+            return;
+        if (lo == hi)
+        {
+            for (int id : buckets[lo])
+            {
+                if (ranges[id].second >= start)
+                    ids.push_back(id);
+            }
+            return;
+        }
+        int mid = (lo + hi) / 2;
+        collect(2 * node, lo, mid, start, end, ids);
+        collect(2 * node + 1, mid + 1, hi, start, end, ids);
+    }
+
+    int days;                                ///< Number of days in the domain
+    std::vector<std::vector<int>> buckets;   ///< Interval ids by start day
+    std::vector<int> maxEnd;                 ///< Segment tree of the latest end day per subtree
+    std::vector<std::pair<int, int>> ranges; ///< (start, end) by id, (-1, -1) if absent
+};
+
+/**
+ * @brief Booking engine used by Hotel::Reserve.
+ */
+enum class BookingEngine
+{
+    BruteForce, ///< Book, over occupied_bf
+    Heap,       ///< Book_V2, over occupied_bf
+    Bitset      ///< Book_V3, over occupied_bs (default)
+};
+
+/**
+ * @brief Room layout constraint for group bookings.
+ */
+enum class GroupLayout
+{
+    Any,       ///< Any free rooms
+    SameFloor, ///< All rooms on one floor (see Hotel::SetFloors)
+    Contiguous ///< Consecutive room numbers
+};
+
+/**
+ * @brief A tentative hold on a room, created by Hotel::Hold.
+ */
+struct HoldRecord
+{
+    int room = -1;           ///< Room index
+    int start = 0;           ///< Start day (inclusive)
+    int end = 0;             ///< End day (inclusive)
+    std::uint64_t expiry = 0; ///< Tick at which the hold is released
+    bool active = false;     ///< False once confirmed, released or expired
+};
+
+/**
+ * @brief A request waiting for capacity, created by Hotel::JoinWaitlist.
+ */
+struct WaitlistEntry
+{
+    int start = 0;       ///< Start day (inclusive)
+    int end = 0;         ///< End day (inclusive)
+    bool waiting = false; ///< True until promoted or withdrawn
+    int bookingId = -1;  ///< Booking created on promotion, -1 if not promoted
+};
+
+/**
+ * @brief A change of availability for a subscribed period, delivered by Hotel::PollNotification.
+ */
+struct AvailabilityNotice
+{
+    int subscriptionId; ///< Subscription whose period changed state
+    bool available;     ///< True if some room is now free for the whole period, false if sold out
+};
+
+/**
+ * @brief A channel manager's watch on a period, created by Hotel::Subscribe.
+ */
+struct Subscription
+{
+    int start = 0;        ///< Start day (inclusive)
+    int end = 0;          ///< End day (inclusive)
+    bool available = false; ///< Last notified state
+    int witness = -1;     ///< A room free for the whole period while available
+    bool active = false;  ///< False once unsubscribed
+};
+
+/**
+ * @brief A room category (standard, deluxe, suite, ...) occupying a contiguous range of room ids.
+ */
+struct RoomCategory
+{
+    std::string name; ///< Category name
+    int first;        ///< First room id of the category
+    int count;        ///< Number of rooms in the category
+};
+
+/**
+ * @brief A booking recorded in the ledger of the bitset engine.
+ */
+struct Reservation
+{
+    int room = -1;      ///< Room index
+    int start = 0;      ///< Start day (inclusive)
+    int end = 0;        ///< End day (inclusive)
+    bool active = false; ///< False once the booking no longer holds its room
+};
+
+/**
+ * @brief One room of a split stay.
+ */
+struct StaySegment
+{
+    int room;  ///< Room index
+    int start; ///< First night in the room (inclusive)
+    int end;   ///< Last night in the room (inclusive)
+};
+
+/**
+ * @brief Offline versus online results for the same set of stays.
+ */
+struct OfflineComparison
+{
+    int requests = 0;            ///< Number of stays submitted
+    int offlineAccepted = 0;     ///< Stays accepted by BookOffline
+    int onlineAccepted = 0;      ///< Stays accepted by Book_V3 in submission order
+    long long offlineNights = 0; ///< Nights accepted by BookOffline
+    long long onlineNights = 0;  ///< Nights accepted by Book_V3
+};
+
+/**
+ * @brief Outcome of Hotel::Verify.
+ */
+struct ConsistencyReport
+{
+    int roomsChecked = 0;      ///< Number of rooms checked
+    std::vector<int> badRooms; ///< Rooms whose occupancy, counters or booking lists disagree, ascending
+    int globalViolations = 0;  ///< Disagreements not tied to one room (ledger, holds, subscriptions)
+
+    bool Ok() const { return badRooms.empty() && globalViolations == 0; }
+};
+
+/**
+ * @class Hotel
+ * @brief Manages hotel room bookings using multiple algorithms for comparison.
+ *
+ * Supports three booking strategies:
+ *   - Book: Brute-force approach over rows of 64-day words (occupied_bf).
+ *   - Book_V2: Heap-based approach over the same word rows.
+ *   - Book_V3: Bitset + utilization array + heap for optimal performance.
+ */
+class Hotel
+{
+    friend void RunVerifyTest(const std::string &testName); // Corrupts private state on purpose
+
+private:
+    int size; ///< Number of rooms in the hotel
+    static const int MaxDays = 366; ///< Maximum number of days (0-based, e.g., 0-365)
+    static const int DayWords = (MaxDays + 63) / 64; ///< Number of 64-day words per room
+    static const int MaxBatchCandidates = 256; ///< Longest ranked candidate list BookBatch keeps per period
+    static const int RepairClockStride = 64; ///< Rooms BookWithRepair scans between looks at the clock
+    using Row_bf = std::array<std::uint64_t, DayWords>; ///< One bit per day, 64 days per word
+    /**
+     * @brief Occupancy tracking for Book and Book_V2 (brute-force/heap-based)
+     * Bit d % 64 of occupied_bf[room][d / 64] is set if room is booked on day d. Rows have a fixed
+     * stride of DayWords words, and each page of 64 rooms is one contiguous block.
+     */
+    PagedArray<Row_bf> occupied_bf;
+    /**
+     * @brief Number of set days in each room's occupied_bf row, maintained on every change
+     */
+    PagedArray<int> utilization_bf;
+    /**
+     * @brief Held and blocked days, mirrored from the bitset state while Reserve uses Book or Book_V2
+     *
+     * Book and Book_V2 treat these days as taken but never count them as utilization.
+     */
+    PagedArray<Row_bf> closed_bf;
+    /**
+     * @brief If true, every read of utilization_bf is cross-checked against a recount
+     */
+    bool verifyUtilization_bf;
+    /**
+     * @brief Number of utilization_bf reads that disagreed with the recount
+     */
+    mutable std::atomic<long long> utilizationMismatches_bf;
+    /**
+     * @brief Number of sampled Verify calls without an explicit seed, used as the next seed
+     */
+    mutable std::atomic<std::uint32_t> verifySamples;
+    using Bitset = std::bitset<MaxDays>;
+    using RoomMask = std::vector<std::uint64_t>; ///< One bit per room, 64 rooms per word
+    /**
+     * @brief Occupancy tracking for Book_V3 (bitset-based)
+     * occupied_bs[room].test(day) == true if room is booked on that day
+     */
+    PagedArray<Bitset> occupied_bs;
+    /**
+     * @brief Utilization array for Book_V3 (number of booked days per room)
+     */
+    PagedArray<int> utilization;
+    /**
+     * @brief Ledger of bitset bookings, indexed by booking id
+     */
+    PagedArray<Reservation> ledger;
+    /**
+     * @brief Ids of the active bitset bookings held by each room
+     */
+    PagedArray<std::vector<int>> roomBookings;
+    /**
+     * @brief Days of occupied_bs that are tentative holds rather than bookings (not in utilization)
+     */
+    PagedArray<Bitset> held_bs;
+    /**
+     * @brief Days of occupied_bs closed for maintenance (not in utilization, disjoint from bookings and holds)
+     */
+    PagedArray<Bitset> blocked_bs;
+    /**
+     * @brief True for rooms taken out of service by RetireRoom (all their days are in blocked_bs)
+     */
+    PagedArray<bool> retired;
+    /**
+     * @brief Holds by id
+     */
+    PagedArray<HoldRecord> holds;
+    /**
+     * @brief Expiry timers of the active holds
+     */
+    TimerWheel holdTimers;
+    /**
+     * @brief Waitlisted requests by id, in arrival order (not carried over by Fork)
+     */
+    std::vector<WaitlistEntry> waitlist;
+    /**
+     * @brief Interval index over the waiting entries of the waitlist
+     */
+    IntervalIndex waitlistIndex;
+    /**
+     * @brief Availability subscriptions by id (not carried over by Fork)
+     */
+    std::vector<Subscription> subscriptions;
+    /**
+     * @brief Interval index over the active subscriptions
+     */
+    IntervalIndex subscriptionIndex;
+    /**
+     * @brief Availability changes waiting for the channel-manager thread
+     */
+    SpscQueue<AvailabilityNotice> notices;
+    /**
+     * @brief Notices dropped because the queue was full
+     */
+    std::atomic<long long> droppedNotices;
+    /**
+     * @brief Serializes commits to the bitset state against snapshot acquisition.
+     *
+     * Held only while a commit writes its room or while a snapshot copies the page directories,
+     * never during a scan, so readers and bookings never wait on each other's work.
+     */
+    mutable std::mutex commitMutex;
+    /**
+     * @brief Room categories in upgrade order, each a contiguous range of room ids
+     */
+    std::vector<RoomCategory> categories;
+    /**
+     * @brief Room mask of each floor for same-floor group bookings (shared, never modified after SetFloors)
+     */
+    std::shared_ptr<const std::vector<RoomMask>> floorMasks;
+    /**
+     * @brief Engine that Reserve dispatches to
+     */
+    std::atomic<BookingEngine> activeEngine;
+    /**
+     * @brief Engine being switched to by the background conversion
+     */
+    BookingEngine switchTarget;
+    /**
+     * @brief Copies of the bitset state the background conversion started from
+     */
+    PagedArray<Bitset> switchSource_bs;
+    PagedArray<Bitset> switchSourceHeld_bs;
+    PagedArray<Bitset> switchSourceBlocked_bs;
+    /**
+     * @brief Booked and closed rows built by the background conversion
+     */
+    PagedArray<Row_bf> converted_bf;
+    PagedArray<Row_bf> convertedClosed_bf;
+    /**
+     * @brief Set by the background conversion when it is done
+     */
+    std::atomic<bool> switchReady;
+    /**
+     * @brief Background conversion thread, joinable while a switch is pending
+     */
+    std::thread switchWorker;
+
+    /**
+     * @brief Adds empty rooms to every per-room array
+     * @param n New number of rooms
+     */
+    void growRooms(int n)
+    {
+        occupied_bf.resize(n, Row_bf());
+        utilization_bf.resize(n, 0);
+        closed_bf.resize(n, Row_bf());
+        occupied_bs.resize(n, Bitset());
+        utilization.resize(n, 0);
+        roomBookings.resize(n, std::vector<int>());
+        held_bs.resize(n, Bitset());
+        blocked_bs.resize(n, Bitset());
+        retired.resize(n, false);
+        size = n;
+    }
+    /**
+     * @brief Counts the number of booked days for a room (brute-force/heap-based)
+     * @param room Room index
+     * @return Number of days the room is booked
+     */
+    int countUtilization_bf(int room) const
+    {
+        int count = 0;
+        for (std::uint64_t word : occupied_bf[room])
+        {
+            count += PopCount(word);
+        }
+        return count;
+    }
+    /**
+     * @brief Returns the number of booked days for a room from the maintained counter (brute-force/heap-based)
+     *
+     * In verification mode the counter is compared with countUtilization_bf, and mismatches are counted.
+     */
+    int utilizationOf_bf(int room) const
+    {
+        if (verifyUtilization_bf && utilization_bf[room] != countUtilization_bf(room))
+            ++utilizationMismatches_bf;
+        return utilization_bf[room];
+    }
+    /**
+     * @brief Returns true if a room is booked or closed on a day (brute-force/heap-based)
+     */
+    bool isOccupied_bf(int room, int day) const
+    {
+        return ((occupied_bf[room][day / 64] | closed_bf[room][day / 64]) >> (day % 64)) & 1;
+    }
+    /**
+     * @brief Marks a room as booked for [start, end] and updates its utilization (brute-force/heap-based)
+     *
+     * The days must be free.
+     */
+    void markOccupied_bf(int room, int start, int end)
+    {
+        Row_bf &row = occupied_bf.mut(room);
+        for (int d = start; d <= end; ++d)
+        {
+            row[d / 64] |= 1ULL << (d % 64);
+        }
+        utilization_bf.mut(room) += end - start + 1;
+    }
+    /**
+     * @brief Counts the free days left on either side of [start, end] in a room (brute-force/heap-based)
+     * @param room Room index
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @return Number of free days between the stay and the neighbouring bookings (or the period bounds)
+     */
+    int gapAround_bf(int room, int start, int end) const
+    {
+        int gap = 0;
+        for (int d = start - 1; d >= 0 && !isOccupied_bf(room, d); --d)
+            ++gap;
+        for (int d = end + 1; d < MaxDays && !isOccupied_bf(room, d); ++d)
+            ++gap;
+        return gap;
+    }
+    /**
+     * @brief Scores a free room under a selection policy (brute-force/heap-based)
+     */
+    template <typename Policy>
+    int score_bf(int room, int start, int end) const
+    {
+        return Policy::Score(utilizationOf_bf(room), Policy::UsesGap ? gapAround_bf(room, start, end) : 0);
+    }
+    /**
+     * @brief Book's room choice: scans every room and day, then takes the best free room
+     * @return Chosen room, or -1 if no room is free
+     */
+    template <typename Policy>
+    int selectRoom_bf(int start, int end) const
+    {
+        // Find all free rooms for the period
+        std::vector<int> freeRooms;
+        for (int r = 0; r < size; ++r)
+        {
+            bool isFree = true;
+            for (int d = start; d <= end; ++d)
+            {
+                if (isOccupied_bf(r, d))
+                {
+                    isFree = false;
+                    break;
+                }
+            }
+            if (isFree)
+            {
+                freeRooms.push_back(r);
+            }
+        }
+
+        // Take the best room under the policy; the default takes the most utilized room
+        // (leave less utilized rooms for future stays). In case of ties, choose the lowest room number
+        int bestScore = 0;
+        int chosenRoom = -1;
+        for (int r : freeRooms)
+        {
+            int score = score_bf<Policy>(r, start, end);
+            if (chosenRoom == -1 || score > bestScore || (score == bestScore && r < chosenRoom))
+            {
+                bestScore = score;
+                chosenRoom = r;
+            }
+        }
+        return chosenRoom;
+    }
+    /**
+     * @brief Book_V2's room choice: scans every room and day, then takes the best free room from a max-heap
+     * @return Chosen room, or -1 if no room is free
+     */
+    template <typename Policy>
+    int selectRoomHeap_bf(int start, int end) const
+    {
+        // Find all free rooms for the period
+        std::vector<int> freeRooms;
+        for (int r = 0; r < size; ++r)
+        {
+            bool isFree = true;
+            for (int d = start; d <= end; ++d)
+            {
+                if (isOccupied_bf(r, d))
+                {
+                    isFree = false;
+                    break;
+                }
+            }
+            if (isFree)
+            {
+                freeRooms.push_back(r);
+            }
+        }
+        if (freeRooms.empty())
+        {
+            return -1;
+        }
+
+        // Use a max-heap to select the best room under the policy (lowest room number in case of tie)
+        using RoomInfo = std::pair<int, int>; // (policy score, -room number)
+        std::priority_queue<RoomInfo> pq;
+        for (int r : freeRooms)
+        {
+            pq.push({score_bf<Policy>(r, start, end), -r});
+        }
+        return -pq.top().second;
+    }
+    /**
+     * @brief Books the room a brute-force selector picks (shared by Book, Book_V2 and Reserve)
+     *
+     * While Reserve uses Book or Book_V2, occupied_bf is a mirror of the bitset state, so the
+     * booking is committed to the bitset state and the ledger under the commit lock and the
+     * occupancy hook copies it into the row; writing only the row would be erased by the next
+     * mirror of that room. Otherwise the brute-force rows are standalone and only the row is marked.
+     *
+     * @param select Returns the chosen room, or -1 if none is free
+     * @param room If not null, receives the chosen room
+     * @param bookingId If not null, receives the ledger id (-1 when the rows are standalone)
+     */
+    template <typename Select>
+    std::string book_bf(int start, int end, Select select, int *room, int *bookingId)
+    {
+        int chosenRoom = -1;
+        int id = -1;
+        if (UsesBruteForceState(activeEngine.load()))
+        {
+            std::lock_guard<std::mutex> lock(commitMutex);
+            chosenRoom = select();
+            if (chosenRoom == -1)
+                return "Decline";
+            id = commitLocked_bs(chosenRoom, start, end);
+        }
+        else
+        {
+            chosenRoom = select();
+            if (chosenRoom == -1)
+                return "Decline";
+            markOccupied_bf(chosenRoom, start, end);
+        }
+        if (room)
+            *room = chosenRoom;
+        if (bookingId)
+            *bookingId = id;
+        return "Accept";
+    }
+    /**
+     * @brief Returns the number of booked days for a room (bitset-based)
+     * @param room Room index
+     * @return Number of days the room is booked
+     */
+    int countUtilization_bs(int room) const
+    {
+        return utilization[room];
+    }
+    /**
+     * @brief Builds a bitset with the days [start, end] set
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @return Mask covering the requested period
+     */
+    static Bitset RangeMask(int start, int end)
+    {
+        Bitset mask;
+        mask.set();
+        mask >>= MaxDays - (end - start + 1);
+        mask <<= start;
+        return mask;
+    }
+    /**
+     * @brief Marks a room as booked for [start, end], updates its utilization and records the booking (bitset-based)
+     * @param room Room index
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @return Id of the new booking
+     */
+    int commit_bs(int room, int start, int end)
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        return commitLocked_bs(room, start, end);
+    }
+    /**
+     * @brief commit_bs for callers that already hold commitMutex
+     *
+     * Everything that can allocate (the ledger slot, the room's list entry, detaching the room's
+     * pages) happens before any state changes, and a failure undoes the steps already taken, so
+     * a throwing commit leaves the room as it was (at most an inactive ledger slot is left over).
+     * The occupancy hooks run last; if they throw, the room's changes are undone as well.
+     */
+    int commitLocked_bs(int room, int start, int end)
+    {
+        Reservation booking;
+        booking.room = room;
+        booking.start = start;
+        booking.end = end;
+        booking.active = false;
+        int id = ledger.size();
+        ledger.resize(id + 1, booking);
+        std::vector<int> &ids = roomBookings.mut(room);
+        ids.push_back(id);
+        Bitset *occupied = nullptr;
+        int *booked = nullptr;
+        try
+        {
+            occupied = &occupied_bs.mut(room);
+            booked = &utilization.mut(room);
+        }
+        catch (...)
+        {
+            ids.pop_back();
+            throw;
+        }
+
+        // Pages are detached from here on, so these writes and their undo cannot throw
+        const Bitset mask = RangeMask(start, end);
+        *occupied |= mask;
+        *booked += end - start + 1;
+        ledger.mut(id).active = true;
+        try
+        {
+            occupancyAdded(room, start, end);
+        }
+        catch (...)
+        {
+            *occupied &= ~mask;
+            *booked -= end - start + 1;
+            ledger.mut(id).active = false;
+            ids.pop_back();
+            throw;
+        }
+        return id;
+    }
+    /**
+     * @brief Frees the room-days of an active booking and marks it inactive (bitset-based)
+     *
+     * Caller must hold commitMutex.
+     *
+     * @param id Booking id
+     */
+    void releaseLocked_bs(int id)
+    {
+        Reservation &booking = ledger.mut(id);
+        occupied_bs.mut(booking.room) &= ~RangeMask(booking.start, booking.end);
+        utilization.mut(booking.room) -= booking.end - booking.start + 1;
+        std::vector<int> &ids = roomBookings.mut(booking.room);
+        ids.erase(std::find(ids.begin(), ids.end(), id));
+        booking.active = false;
+        occupancyRemoved(booking.room, booking.start, booking.end);
+    }
+    /**
+     * @brief Commits the first n rooms of a ranked list for [start, end], all or none (bitset-based)
+     * @param ranked (score, -room number) pairs, best first
+     * @param n Number of rooms to book
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param bookingIds If not null, receives the ids of the bookings
+     * @return "Accept" once all rooms are booked
+     */
+    std::string commitGroup_bs(const std::vector<std::pair<int, int>> &ranked, int n, int start, int end,
+                               std::vector<int> *bookingIds)
+    {
+        std::vector<int> ids;
+        ids.reserve(n);
+        std::lock_guard<std::mutex> lock(commitMutex);
+        try
+        {
+            for (int i = 0; i < n; ++i)
+            {
+                ids.push_back(commitLocked_bs(-ranked[i].second, start, end));
+            }
+        }
+        catch (...)
+        {
+            for (int id : ids)
+            {
+                releaseLocked_bs(id);
+            }
+            throw;
+        }
+        if (bookingIds)
+            *bookingIds = ids;
+        return "Accept";
+    }
+    /**
+     * @brief Frees the days of a hold if it is still active
+     *
+     * Caller must hold commitMutex.
+     *
+     * @param holdId Hold id
+     */
+    bool releaseHoldLocked(int holdId)
+    {
+        if (holdId < 0 || holdId >= holds.size() || !holds[holdId].active)
+            return false;
+        HoldRecord &hold = holds.mut(holdId);
+        hold.active = false;
+        const Bitset mask = RangeMask(hold.start, hold.end);
+        held_bs.mut(hold.room) &= ~mask;
+        occupied_bs.mut(hold.room) &= ~mask;
+        occupancyRemoved(hold.room, hold.start, hold.end);
+        return true;
+    }
+    /**
+     * @brief Finds the lowest-numbered room free for [start, end], or -1 (bitset-based)
+     */
+    int firstFreeRoom_bs(int start, int end) const
+    {
+        const Bitset mask = RangeMask(start, end);
+        for (int r = 0; r < size; ++r)
+        {
+            if ((occupied_bs[r] & mask).none())
+                return r;
+        }
+        return -1;
+    }
+    /**
+     * @brief Queues an availability notice for the channel-manager thread
+     */
+    void notify(int subscriptionId, bool available)
+    {
+        if (!notices.TryPush({subscriptionId, available}))
+            ++droppedNotices;
+    }
+    /**
+     * @brief Notifies subscribers that sold out because a room's days [start, end] were taken
+     *
+     * Only subscriptions overlapping the days are visited, and only those whose witness room was
+     * taken need a rescan. The brute-force rows are refreshed too while Reserve uses them.
+     * Caller must hold commitMutex.
+     */
+    void occupancyAdded(int room, int start, int end)
+    {
+        mirrorRoomLocked_bf(room);
+        for (int id : subscriptionIndex.Overlapping(start, end))
+        {
+            Subscription &subscription = subscriptions[id];
+            if (!subscription.available || subscription.witness != room)
+                continue;
+            subscription.witness = firstFreeRoom_bs(subscription.start, subscription.end);
+            if (subscription.witness == -1)
+            {
+                subscription.available = false;
+                notify(id, false);
+            }
+        }
+    }
+    /**
+     * @brief Notifies sold-out subscribers that a room's days [start, end] became free
+     *
+     * Only subscriptions overlapping the days are visited, and each needs a single mask test on
+     * the freed room. The brute-force rows are refreshed too while Reserve uses them. Caller
+     * must hold commitMutex.
+     */
+    void occupancyRemoved(int room, int start, int end)
+    {
+        mirrorRoomLocked_bf(room);
+        for (int id : subscriptionIndex.Overlapping(start, end))
+        {
+            Subscription &subscription = subscriptions[id];
+            if (subscription.available || (occupied_bs[room] & RangeMask(subscription.start, subscription.end)).any())
+                continue;
+            subscription.available = true;
+            subscription.witness = room;
+            notify(id, true);
+        }
+    }
+    /**
+     * @brief Retries the waitlisted requests overlapping days that just became free in some rooms
+     *
+     * Only entries overlapping [start, end] can have become bookable, so only those are found (via
+     * the interval index) and retried, in arrival order. A waiting entry found no free room when
+     * it was last tried, so only the freed rooms can fit it now: each entry costs one mask test per
+     * freed room (usually one) instead of a Book_V3 scan, and is booked in the most utilized freed
+     * room that fits, as Book_V3 would choose. Caller must not hold commitMutex.
+     *
+     * @param firstRoom First room with freed days
+     * @param lastRoom Last room with freed days (inclusive)
+     * @param start First freed day (inclusive)
+     * @param end Last freed day (inclusive)
+     */
+    void capacityFreed(int firstRoom, int lastRoom, int start, int end)
+    {
+        for (int id : waitlistIndex.Overlapping(start, end))
+        {
+            WaitlistEntry &entry = waitlist[id];
+            const Bitset mask = RangeMask(entry.start, entry.end);
+            std::lock_guard<std::mutex> lock(commitMutex);
+            int chosenRoom = -1;
+            int bestScore = 0;
+            for (int r = firstRoom; r <= lastRoom; ++r)
+            {
+                if ((occupied_bs[r] & mask).any())
+                    continue;
+                int score = score_bs<MostUtilizedPolicy>(r, entry.start, entry.end);
+                if (chosenRoom == -1 || score > bestScore)
+                {
+                    chosenRoom = r;
+                    bestScore = score;
+                }
+            }
+            if (chosenRoom == -1)
+                continue;
+            entry.bookingId = commitLocked_bs(chosenRoom, entry.start, entry.end);
+            entry.waiting = false;
+            waitlistIndex.Erase(id);
+        }
+    }
+    /**
+     * @brief Moves an active booking to another room, keeping its id (bitset-based)
+     * @param id Booking id
+     * @param room Destination room (must be free for the booking's period)
+     */
+    void move_bs(int id, int room)
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        const Reservation &booking = ledger[id];
+        relocateLocked_bs(id, room, booking.start, booking.end);
+    }
+    /**
+     * @brief Moves an active booking to another room and period, keeping its id (bitset-based)
+     *
+     * Caller must hold commitMutex.
+     *
+     * @param id Booking id
+     * @param room Destination room (must be free for the new period)
+     * @param start New start day (inclusive)
+     * @param end New end day (inclusive)
+     */
+    void relocateLocked_bs(int id, int room, int start, int end)
+    {
+        Reservation &booking = ledger.mut(id);
+        occupied_bs.mut(booking.room) &= ~RangeMask(booking.start, booking.end);
+        utilization.mut(booking.room) -= booking.end - booking.start + 1;
+        std::vector<int> &ids = roomBookings.mut(booking.room);
+        ids.erase(std::find(ids.begin(), ids.end(), id));
+        occupancyRemoved(booking.room, booking.start, booking.end);
+
+        booking.room = room;
+        booking.start = start;
+        booking.end = end;
+        occupied_bs.mut(room) |= RangeMask(start, end);
+        utilization.mut(room) += end - start + 1;
+        roomBookings.mut(room).push_back(id);
+        occupancyAdded(room, start, end);
+    }
+    /**
+     * @brief Runs fn(firstRoom, lastRoom) on worker threads over disjoint ranges of whole room pages
+     *
+     * No two workers touch elements of the same page, so once the pages are detached (written
+     * once through mut()) each worker can write its rooms without further copying.
+     *
+     * @param rooms Number of rooms to cover
+     * @param fn Called with [firstRoom, lastRoom) for each worker's range
+     */
+    template <typename Fn>
+    static void parallelOverRooms(int rooms, Fn fn)
+    {
+        const int pageSize = PagedArray<Bitset>::PageSize;
+        const int pages = (rooms + pageSize - 1) / pageSize;
+        const int hardware = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        const int workerCount = std::min(pages, hardware);
+        if (workerCount <= 1)
+        {
+            fn(0, rooms);
+            return;
+        }
+        std::vector<std::thread> workers;
+        for (int t = 0; t < workerCount; ++t)
+        {
+            int firstRoom = static_cast<int>(static_cast<long long>(pages) * t / workerCount) * pageSize;
+            int lastRoom = std::min(rooms, static_cast<int>(static_cast<long long>(pages) * (t + 1) / workerCount) * pageSize);
+            workers.emplace_back(fn, firstRoom, lastRoom);
+        }
+        for (std::thread &worker : workers)
+        {
+            worker.join();
+        }
+    }
+    /**
+     * @brief Recomputes every active subscription from scratch, notifying those whose state flipped
+     *
+     * Caller must hold commitMutex.
+     */
+    void refreshSubscriptionsLocked()
+    {
+        for (int id = 0; id < static_cast<int>(subscriptions.size()); ++id)
+        {
+            Subscription &subscription = subscriptions[id];
+            if (!subscription.active)
+                continue;
+            subscription.witness = firstFreeRoom_bs(subscription.start, subscription.end);
+            bool available = subscription.witness != -1;
+            if (available != subscription.available)
+            {
+                subscription.available = available;
+                notify(id, available);
+            }
+        }
+    }
+    /**
+     * @brief Returns true if an engine selects rooms from occupied_bf
+     */
+    static bool UsesBruteForceState(BookingEngine engine)
+    {
+        return engine != BookingEngine::Bitset;
+    }
+    /**
+     * @brief Copies a room's bitset state into the brute-force rows while Reserve uses Book or Book_V2
+     *
+     * Called from the occupancy hooks, so every change to the bitset state (cancellations, holds,
+     * blackouts, waitlist promotions...) is seen by the brute-force engines. Caller must hold commitMutex.
+     */
+    void mirrorRoomLocked_bf(int room)
+    {
+        if (!UsesBruteForceState(activeEngine.load()))
+            return;
+        occupied_bf.mut(room) = ToRow_bf(occupied_bs[room] & ~held_bs[room] & ~blocked_bs[room]);
+        closed_bf.mut(room) = ToRow_bf(held_bs[room] | blocked_bs[room]);
+        utilization_bf.mut(room) = utilization[room];
+    }
+    /**
+     * @brief Converts a bitset row to a brute-force row
+     */
+    static Row_bf ToRow_bf(const Bitset &bits)
+    {
+        Row_bf row;
+        for (int w = 0; w < DayWords; ++w)
+        {
+            row[w] = DayWord(bits, w);
+        }
+        return row;
+    }
+    /**
+     * @brief Background conversion: splits the copied bitset state into booked and closed rows
+     */
+    void convertForSwitch()
+    {
+        const int rooms = switchSource_bs.size();
+        converted_bf = PagedArray<Row_bf>(rooms, Row_bf());
+        convertedClosed_bf = PagedArray<Row_bf>(rooms, Row_bf());
+        for (int r = 0; r < rooms; ++r)
+        {
+            const Bitset closed = switchSourceHeld_bs[r] | switchSourceBlocked_bs[r];
+            converted_bf.mut(r) = ToRow_bf(switchSource_bs[r] & ~closed);
+            convertedClosed_bf.mut(r) = ToRow_bf(closed);
+        }
+        switchReady = true;
+    }
+    /**
+     * @brief Extracts 64 days of a bitset as a word
+     * @param bits Occupancy bitset
+     * @param w Word index (days [64 * w, 64 * w + 63])
+     * @return Word with bit i set if day 64 * w + i is set
+     */
+    static std::uint64_t DayWord(const Bitset &bits, int w)
+    {
+        return ((bits >> (64 * w)) & Bitset(~0ULL)).to_ullong();
+    }
+    /**
+     * @brief Finds the first set day of a bitset
+     * @param bits Day bitset
+     * @return First set day, or MaxDays if none
+     */
+    static int FirstSetDay(const Bitset &bits)
+    {
+        for (int w = 0; w < DayWords; ++w)
+        {
+            std::uint64_t word = DayWord(bits, w);
+            if (word != 0)
+                return 64 * w + LowestSetBit(word);
+        }
+        return MaxDays;
+    }
+    /**
+     * @brief Finds the last occupied day before a given day (bitset-based)
+     * @param room Room index
+     * @param day Day to look back from (exclusive)
+     * @return Last occupied day before day, or -1 if none
+     */
+    int prevOccupied_bs(int room, int day) const
+    {
+        return PrevSetDay(occupied_bs[room], day);
+    }
+    /**
+     * @brief Finds the last set day of a bitset before a given day
+     * @param bits Day bitset
+     * @param day Day to look back from (exclusive)
+     * @return Last set day before day, or -1 if none
+     */
+    static int PrevSetDay(const Bitset &bits, int day)
+    {
+        if (day <= 0)
+            return -1;
+        int w = (day - 1) / 64;
+        int keep = (day - 1) % 64 + 1; // Bits of word w that lie before day
+        std::uint64_t word = DayWord(bits, w);
+        if (keep < 64)
+            word &= (1ULL << keep) - 1;
+        while (word == 0)
+        {
+            if (--w < 0)
+                return -1;
+            word = DayWord(bits, w);
+        }
+        return 64 * w + HighestSetBit(word);
+    }
+    /**
+     * @brief Finds the first occupied day after a given day (bitset-based)
+     * @param room Room index
+     * @param day Day to look forward from (exclusive)
+     * @return First occupied day after day, or MaxDays if none
+     */
+    int nextOccupied_bs(int room, int day) const
+    {
+        return NextSetDay(occupied_bs[room], day);
+    }
+    /**
+     * @brief Finds the first set day of a bitset after a given day
+     * @param bits Day bitset
+     * @param day Day to look forward from (exclusive)
+     * @return First set day after day, or MaxDays if none
+     */
+    static int NextSetDay(const Bitset &bits, int day)
+    {
+        if (day >= MaxDays - 1)
+            return MaxDays;
+        int w = (day + 1) / 64;
+        std::uint64_t word = DayWord(bits, w) & (~0ULL << ((day + 1) % 64));
+        while (word == 0)
+        {
+            if (++w >= DayWords)
+                return MaxDays;
+            word = DayWord(bits, w);
+        }
+        return 64 * w + LowestSetBit(word);
+    }
+    /**
+     * @brief Counts the free days left on either side of [start, end] in a room (bitset-based)
+     *
+     * Uses bit scans over the occupancy words, so the cost does not depend on the gap length.
+     *
+     * @param room Room index
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @return Number of free days between the stay and the neighbouring bookings (or the period bounds)
+     */
+    int gapAround_bs(int room, int start, int end) const
+    {
+        return (start - prevOccupied_bs(room, start) - 1) + (nextOccupied_bs(room, end) - end - 1);
+    }
+    /**
+     * @brief Builds the set of rooms free on each day of [start, end] (bitset-based)
+     *
+     * Works on 64 rooms x 64 days at a time: the rooms' occupancy words for one day word are
+     * transposed, so each day's mask for those rooms comes out as one word.
+     *
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @return One room mask per day, index 0 for start
+     */
+    std::vector<RoomMask> freeRoomsByDay_bs(int start, int end) const
+    {
+        const int words = (size + 63) / 64;
+        std::vector<RoomMask> freeByDay(end - start + 1, RoomMask(words, 0));
+        std::uint64_t block[64];
+        for (int rw = 0; rw < words; ++rw)
+        {
+            const int rooms = std::min(64, size - 64 * rw);
+            const std::uint64_t inHotel = rooms == 64 ? ~0ULL : (1ULL << rooms) - 1;
+            for (int w = start / 64; w <= end / 64; ++w)
+            {
+                for (int i = 0; i < 64; ++i)
+                    block[i] = i < rooms ? DayWord(occupied_bs[64 * rw + i], w) : ~0ULL;
+                Transpose64(block); // block[i] = rooms occupied on day 64 * w + i
+                for (int d = std::max(start, 64 * w); d <= std::min(end, 64 * w + 63); ++d)
+                    freeByDay[d - start][rw] = ~block[d - 64 * w] & inHotel;
+            }
+        }
+        return freeByDay;
+    }
+    /**
+     * @brief Builds the set of rooms free for the whole of [start, end] (bitset-based)
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @return Room mask with bit r set if room r is free
+     */
+    RoomMask freeRoomMask_bs(int start, int end) const
+    {
+        const Bitset mask = RangeMask(start, end);
+        RoomMask freeRooms((size + 63) / 64, 0);
+        for (int r = 0; r < size; ++r)
+        {
+            if ((occupied_bs[r] & mask).none())
+                freeRooms[r / 64] |= 1ULL << (r % 64);
+        }
+        return freeRooms;
+    }
+    /**
+     * @brief Scores a free room under a selection policy (bitset-based)
+     */
+    template <typename Policy>
+    int score_bs(int room, int start, int end) const
+    {
+        return Policy::Score(utilization[room], Policy::UsesGap ? gapAround_bs(room, start, end) : 0);
+    }
+    /**
+     * @brief Selects the best room free for [start, end] under a selection policy (bitset-based)
+     * @tparam Policy Room-selection policy
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param firstRoom First room to consider
+     * @param lastRoom One past the last room to consider
+     * @return Chosen room index, or -1 if no room is free
+     */
+    template <typename Policy>
+    int selectRoom_bs(int start, int end, int firstRoom, int lastRoom) const
+    {
+        std::vector<int> freeRooms;
+        for (int r = firstRoom; r < lastRoom; ++r)
+        {
+            bool isFree = true;
+            for (int d = start; d <= end; ++d)
+            {
+                if (occupied_bs[r].test(d))
+                {
+                    isFree = false;
+                    break;
+                }
+            }
+            if (isFree)
+            {
+                if (Policy::TakeFirst)
+                    return r;
+                freeRooms.push_back(r);
+            }
+        }
+        if (freeRooms.empty())
+            return -1;
+
+        // Use a max-heap to select the best room under the policy (lowest room number in case of tie)
+        using RoomInfo = std::pair<int, int>; // (policy score, -room number)
+        std::priority_queue<RoomInfo> pq;
+        for (int r : freeRooms)
+        {
+            pq.push({score_bs<Policy>(r, start, end), -r});
+        }
+        return -pq.top().second;
+    }
+
+public:
+    /**
+     * @class Snapshot
+     * @brief Consistent read-only view of the bitset state (occupied_bs and utilization).
+     *
+     * A snapshot shares the hotel's pages copy-on-write, so taking one is O(1) and
+     * later bookings copy only the pages they touch. Queries on a snapshot never take a lock and can
+     * run on any thread while Book_V3 keeps committing.
+     */
+    class Snapshot
+    {
+    public:
+        /**
+         * @brief Returns the number of rooms in the snapshot.
+         */
+        int Size() const
+        {
+            return size;
+        }
+
+        /**
+         * @brief Returns the number of booked days for a room.
+         * @param room Room index
+         */
+        int Utilization(int room) const
+        {
+            return utilization[room];
+        }
+
+        /**
+         * @brief Counts the rooms free for the whole period.
+         * @param start Start day (inclusive)
+         * @param end End day (inclusive)
+         * @return Number of free rooms, 0 for an invalid period
+         */
+        int CountAvailable(int start, int end) const
+        {
+            if (start < 0 || end >= MaxDays || start > end)
+                return 0;
+            const Bitset mask = RangeMask(start, end);
+            int count = 0;
+            for (int r = 0; r < size; ++r)
+            {
+                if ((occupied_bs[r] & mask).none())
+                    ++count;
+            }
+            return count;
+        }
+
+        /**
+         * @brief Returns true if at least one room is free for the whole period.
+         * @param start Start day (inclusive)
+         * @param end End day (inclusive)
+         */
+        bool IsAvailable(int start, int end) const
+        {
+            if (start < 0 || end >= MaxDays || start > end)
+                return false;
+            const Bitset mask = RangeMask(start, end);
+            for (int r = 0; r < size; ++r)
+            {
+                if ((occupied_bs[r] & mask).none())
+                    return true;
+            }
+            return false;
+        }
+
+    private:
+        friend class Hotel;
+        Snapshot(int s, const PagedArray<Bitset> &occupied, const PagedArray<int> &util)
+            : size(s), occupied_bs(occupied), utilization(util) {}
+
+        int size;
+        PagedArray<Bitset> occupied_bs;
+        PagedArray<int> utilization;
+    };
+
+    /**
+     * @brief Constructs a Hotel with the given number of rooms.
+     * @param s Number of rooms
+     */
+    Hotel(int s)
+        : size(s),
+          occupied_bf(s, Row_bf()),
+          utilization_bf(s, 0),
+          closed_bf(s, Row_bf()),
+          verifyUtilization_bf(false),
+          utilizationMismatches_bf(0),
+          verifySamples(0),
+          occupied_bs(s, Bitset()),
+          utilization(s, 0),
+          roomBookings(s, std::vector<int>()),
+          held_bs(s, Bitset()),
+          blocked_bs(s, Bitset()),
+          retired(s, false),
+          waitlistIndex(MaxDays),
+          subscriptionIndex(MaxDays),
+          notices(4096),
+          droppedNotices(0),
+          categories(1, RoomCategory{"Standard", 0, s}),
+          activeEngine(BookingEngine::Bitset),
+          switchTarget(BookingEngine::Bitset),
+          switchReady(false) {}
+
+    /**
+     * @brief Waits for a pending background engine switch, discarding it.
+     */
+    ~Hotel()
+    {
+        if (switchWorker.joinable())
+            switchWorker.join();
+    }
+
+    /**
+     * @brief Constructs a Hotel with typed rooms.
+     *
+     * Rooms are numbered category by category, so each category is a contiguous id range and a
+     * scan of one category reads only the pages covering that range. Categories are not padded to
+     * page boundaries, so neighbouring categories may share the page where one ends and the next
+     * begins.
+     *
+     * @param roomsPerCategory (name, number of rooms) for each category, in upgrade order
+     */
+    Hotel(const std::vector<std::pair<std::string, int>> &roomsPerCategory)
+        : Hotel(0)
+    {
+        categories.clear();
+        int total = 0;
+        for (const auto &category : roomsPerCategory)
+        {
+            categories.push_back({category.first, total, category.second});
+            total += category.second;
+        }
+        growRooms(total);
+    }
+
+    /**
+     * @brief Brute-force booking: finds the most utilized available room for the requested period.
+     *
+     * While Reserve uses Book or Book_V2 the booking is also recorded in the bitset state and the
+     * ledger (as Reserve does), so later mirroring of the room keeps it.
+     *
+     * @tparam Policy Room-selection policy (default: most utilized)
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param room If not null, receives the chosen room
+     * @return "Accept" if booking is successful, "Decline" otherwise
+     */
+    template <typename Policy = MostUtilizedPolicy>
+    std::string Book(int start, int end, int *room = nullptr)
+    {
+        if (start < 0 || end >= MaxDays || start > end)
+        {
+            return "Decline";
+        }
+        return book_bf(start, end, [this, start, end]
+                       { return selectRoom_bf<Policy>(start, end); }, room, nullptr);
+    }
+
+    /**
+     * @brief Heap-based booking: selects the most utilized available room using a max-heap.
+     *
+     * While Reserve uses Book or Book_V2 the booking is also recorded in the bitset state and the
+     * ledger (as Reserve does), so later mirroring of the room keeps it.
+     *
+     * @tparam Policy Room-selection policy (default: most utilized)
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param room If not null, receives the chosen room
+     * @return "Accept" if booking is successful, "Decline" otherwise
+     */
+    template <typename Policy = MostUtilizedPolicy>
+    std::string Book_V2(int start, int end, int *room = nullptr)
+    {
+        if (start < 0 || end >= MaxDays || start > end)
+        {
+            return "Decline";
+        }
+        return book_bf(start, end, [this, start, end]
+                       { return selectRoomHeap_bf<Policy>(start, end); }, room, nullptr);
+    }
+    /**
+     * @brief Bitset + heap + utilization array: most optimal booking approach.
+     *
+     * Uses bitsets for fast occupancy checks, a utilization array for O(1) lookup, and a heap for efficient selection.
+     *
+     * @tparam Policy Room-selection policy (default: most utilized)
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param bookingId If not null, receives the id of the accepted booking
+     * @return "Accept" if booking is successful, "Decline" otherwise
+     */
+    template <typename Policy = MostUtilizedPolicy>
+    std::string Book_V3(int start, int end, int *bookingId = nullptr)
+    {
+        if (start < 0 || end >= MaxDays || start > end)
+            return "Decline";
+
+        int chosenRoom = selectRoom_bs<Policy>(start, end, 0, size);
+        if (chosenRoom == -1)
+            return "Decline";
+
+        // Assign the booking
+        int id = commit_bs(chosenRoom, start, end);
+        if (bookingId)
+            *bookingId = id;
+        return "Accept";
+    }
+
+    /**
+     * @brief Group booking: books n rooms for the same period, all or none.
+     *
+     * One pass over the rooms collects the free ones with their policy scores, and a partial sort
+     * picks the n best. This is the same set of rooms that n consecutive Book_V3 calls would
+     * choose, since a booking only changes the score of the room it takes. All rooms are committed
+     * under a single hold of the commit lock, so snapshots see either the whole group or none of
+     * it, and any failure part-way rolls back the rooms already committed.
+     *
+     * @tparam Policy Room-selection policy (default: most utilized)
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param n Number of rooms
+     * @param bookingIds If not null, receives the ids of the accepted bookings
+     * @return "Accept" if all n rooms were booked, "Decline" otherwise (nothing is booked)
+     */
+    template <typename Policy = MostUtilizedPolicy>
+    std::string BookGroup(int start, int end, int n, std::vector<int> *bookingIds = nullptr)
+    {
+        if (start < 0 || end >= MaxDays || start > end || n < 1)
+            return "Decline";
+
+        const Bitset mask = RangeMask(start, end);
+        using RoomInfo = std::pair<int, int>; // (policy score, -room number)
+        std::vector<RoomInfo> freeRooms;
+        for (int r = 0; r < size; ++r)
+        {
+            if ((occupied_bs[r] & mask).none())
+                freeRooms.push_back({score_bs<Policy>(r, start, end), -r});
+            if (Policy::TakeFirst && static_cast<int>(freeRooms.size()) == n)
+                break;
+        }
+        if (static_cast<int>(freeRooms.size()) < n)
+            return "Decline";
+        std::partial_sort(freeRooms.begin(), freeRooms.begin() + n, freeRooms.end(), std::greater<RoomInfo>());
+
+        return commitGroup_bs(freeRooms, n, start, end, bookingIds);
+    }
+
+    /**
+     * @brief Assigns rooms to floors for same-floor group bookings.
+     * @param floorOfRoom Floor index of each room (-1 for rooms on no floor); rooms beyond its size are on no floor
+     *
+     * Rooms added later by AddRooms are on no floor until SetFloors is called again.
+     */
+    void SetFloors(const std::vector<int> &floorOfRoom)
+    {
+        const int words = (size + 63) / 64;
+        std::shared_ptr<std::vector<RoomMask>> masks = std::make_shared<std::vector<RoomMask>>();
+        for (int r = 0; r < size && r < static_cast<int>(floorOfRoom.size()); ++r)
+        {
+            int floor = floorOfRoom[r];
+            if (floor < 0)
+                continue;
+            if (floor >= static_cast<int>(masks->size()))
+                masks->resize(floor + 1, RoomMask(words, 0));
+            (*masks)[floor][r / 64] |= 1ULL << (r % 64);
+        }
+        floorMasks = masks;
+    }
+
+    /**
+     * @brief Group booking with a room layout constraint, all or none.
+     *
+     * Starts from the mask of rooms free for the period (one bit per room). For SameFloor, the
+     * mask is AND-ed with each floor's mask and popcounted, and the floor whose n best rooms have
+     * the highest total policy score wins (lowest floor on ties). For Contiguous, a run-length
+     * scan over the mask, skipping full and empty words, finds runs of at least n free rooms, and
+     * a sliding sum picks the n consecutive rooms with the highest total score (lowest numbers on
+     * ties). Rooms are committed as in BookGroup.
+     *
+     * @tparam Policy Room-selection policy (default: most utilized)
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param n Number of rooms
+     * @param layout Layout constraint
+     * @param bookingIds If not null, receives the ids of the accepted bookings
+     * @return "Accept" if all n rooms were booked, "Decline" otherwise (nothing is booked)
+     */
+    template <typename Policy = MostUtilizedPolicy>
+    std::string BookGroup(int start, int end, int n, GroupLayout layout, std::vector<int> *bookingIds = nullptr)
+    {
+        if (layout == GroupLayout::Any)
+            return BookGroup<Policy>(start, end, n, bookingIds);
+        if (start < 0 || end >= MaxDays || start > end || n < 1)
+            return "Decline";
+
+        const RoomMask freeRooms = freeRoomMask_bs(start, end);
+        const int words = static_cast<int>(freeRooms.size());
+        using RoomInfo = std::pair<int, int>; // (policy score, -room number)
+        std::vector<RoomInfo> best;
+        long long bestTotal = 0;
+
+        if (layout == GroupLayout::SameFloor)
+        {
+            if (!floorMasks)
+                return "Decline";
+            for (const RoomMask &floor : *floorMasks)
+            {
+                const int floorWords = std::min(words, static_cast<int>(floor.size())); // Rooms added later are on no floor
+                int count = 0;
+                for (int w = 0; w < floorWords; ++w)
+                    count += PopCount(freeRooms[w] & floor[w]);
+                if (count < n)
+                    continue;
+
+                std::vector<RoomInfo> rooms;
+                for (int w = 0; w < floorWords; ++w)
+                {
+                    for (std::uint64_t bits = freeRooms[w] & floor[w]; bits != 0; bits &= bits - 1)
+                    {
+                        int r = 64 * w + LowestSetBit(bits);
+                        rooms.push_back({score_bs<Policy>(r, start, end), -r});
+                    }
+                }
+                std::partial_sort(rooms.begin(), rooms.begin() + n, rooms.end(), std::greater<RoomInfo>());
+                long long total = 0;
+                for (int i = 0; i < n; ++i)
+                    total += rooms[i].first;
+                if (best.empty() || total > bestTotal)
+                {
+                    rooms.resize(n);
+                    best.swap(rooms);
+                    bestTotal = total;
+                }
+            }
+        }
+        else
+        {
+            // Keeps the best n consecutive rooms of the free run [first, last) by sliding sum of scores
+            auto considerRun = [&](int first, int last)
+            {
+                if (last - first < n)
+                    return;
+                std::vector<int> scores;
+                for (int r = first; r < last; ++r)
+                    scores.push_back(score_bs<Policy>(r, start, end));
+                long long total = 0;
+                for (int i = 0; i < n; ++i)
+                    total += scores[i];
+                int windowStart = 0;
+                long long windowBest = total;
+                for (int i = n; i < last - first; ++i)
+                {
+                    total += scores[i] - scores[i - n];
+                    if (total > windowBest)
+                    {
+                        windowBest = total;
+                        windowStart = i - n + 1;
+                    }
+                }
+                if (best.empty() || windowBest > bestTotal)
+                {
+                    best.clear();
+                    for (int i = windowStart; i < windowStart + n; ++i)
+                        best.push_back({scores[i], -(first + i)});
+                    bestTotal = windowBest;
+                }
+            };
+
+            // Run-length scan over the free mask; full and empty words are handled a word at a time
+            int runStart = -1;
+            for (int w = 0; w < words; ++w)
+            {
+                const std::uint64_t word = freeRooms[w];
+                if (word == ~0ULL)
+                {
+                    if (runStart == -1)
+                        runStart = 64 * w;
+                    continue;
+                }
+                if (word == 0)
+                {
+                    if (runStart != -1)
+                        considerRun(runStart, 64 * w);
+                    runStart = -1;
+                    continue;
+                }
+                for (int b = 0; b < 64; ++b)
+                {
+                    int r = 64 * w + b;
+                    if (word >> b & 1)
+                    {
+                        if (runStart == -1)
+                            runStart = r;
+                    }
+                    else if (runStart != -1)
+                    {
+                        considerRun(runStart, r);
+                        runStart = -1;
+                    }
+                }
+            }
+            if (runStart != -1)
+                considerRun(runStart, size);
+        }
+
+        if (best.empty())
+            return "Decline";
+        return commitGroup_bs(best, n, start, end, bookingIds);
+    }
+
+    /**
+     * @brief Typed booking: Book_V3 restricted to the rooms of one category.
+     *
+     * Scans only the category's id range. With allowUpgrade, categories after the requested one
+     * are tried in order until one has a free room.
+     *
+     * @tparam Policy Room-selection policy (default: most utilized)
+     * @param category Requested category index
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param allowUpgrade Whether to fall back to the following categories
+     * @param bookingId If not null, receives the id of the accepted booking
+     * @return "Accept" if booking is successful, "Decline" otherwise
+     */
+    template <typename Policy = MostUtilizedPolicy>
+    std::string BookTyped(int category, int start, int end, bool allowUpgrade = false, int *bookingId = nullptr)
+    {
+        if (start < 0 || end >= MaxDays || start > end || category < 0)
+            return "Decline";
+
+        const int last = allowUpgrade ? static_cast<int>(categories.size()) : std::min(category + 1, static_cast<int>(categories.size()));
+        for (int c = category; c < last; ++c)
+        {
+            const RoomCategory &rooms = categories[c];
+            int chosenRoom = selectRoom_bs<Policy>(start, end, rooms.first, rooms.first + rooms.count);
+            if (chosenRoom == -1)
+                continue;
+            int id = commit_bs(chosenRoom, start, end);
+            if (bookingId)
+                *bookingId = id;
+            return "Accept";
+        }
+        return "Decline";
+    }
+
+    /**
+     * @brief Returns the category index of a room.
+     * @param room Room index
+     */
+    int CategoryOf(int room) const
+    {
+        auto it = std::upper_bound(categories.begin(), categories.end(), room, [](int r, const RoomCategory &category)
+                                   { return r < category.first; });
+        return static_cast<int>(it - categories.begin()) - 1;
+    }
+
+    /**
+     * @brief Puts a room on tentative hold for [start, end] until the clock reaches now + ttl.
+     *
+     * The room is chosen as Book_V3 would choose it, and its days are marked occupied so no other
+     * request can take them, but the hold does not count towards utilization until confirmed, so
+     * utilization-based scores (most or least utilized) for other requests are unaffected. Held
+     * days do count as occupied when BestFitGap measures the free gap around a stay, so that
+     * policy may choose differently while a hold is pending.
+     *
+     * @tparam Policy Room-selection policy (default: most utilized)
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param ttl Ticks until the hold expires (see AdvanceClock)
+     * @return Hold id, or -1 if no room is free
+     */
+    template <typename Policy = MostUtilizedPolicy>
+    int Hold(int start, int end, std::uint64_t ttl)
+    {
+        if (start < 0 || end >= MaxDays || start > end)
+            return -1;
+        int chosenRoom = selectRoom_bs<Policy>(start, end, 0, size);
+        if (chosenRoom == -1)
+            return -1;
+
+        std::lock_guard<std::mutex> lock(commitMutex);
+        const Bitset mask = RangeMask(start, end);
+        occupied_bs.mut(chosenRoom) |= mask;
+        held_bs.mut(chosenRoom) |= mask;
+        occupancyAdded(chosenRoom, start, end);
+        HoldRecord hold;
+        hold.room = chosenRoom;
+        hold.start = start;
+        hold.end = end;
+        hold.expiry = holdTimers.Now() + ttl;
+        hold.active = true;
+        int id = holds.size();
+        holds.resize(id + 1, hold);
+        holdTimers.Schedule(id, hold.expiry);
+        return id;
+    }
+
+    /**
+     * @brief Turns an active hold into a booking in the same room.
+     * @param holdId Hold id, as returned by Hold
+     * @param bookingId If not null, receives the id of the booking
+     * @return "Accept" if the hold was still active, "Decline" if it had expired or was released
+     */
+    std::string Confirm(int holdId, int *bookingId = nullptr)
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        if (holdId < 0 || holdId >= holds.size() || !holds[holdId].active)
+            return "Decline";
+        HoldRecord &hold = holds.mut(holdId);
+        hold.active = false;
+        const Bitset mask = RangeMask(hold.start, hold.end);
+        held_bs.mut(hold.room) &= ~mask;
+        occupied_bs.mut(hold.room) &= ~mask;
+        int id = commitLocked_bs(hold.room, hold.start, hold.end);
+        if (bookingId)
+            *bookingId = id;
+        return "Accept";
+    }
+
+    /**
+     * @brief Releases an active hold, freeing its days. Does nothing if the hold is no longer active.
+     *
+     * Waitlisted requests overlapping the freed days are retried.
+     *
+     * @param holdId Hold id, as returned by Hold
+     */
+    void Release(int holdId)
+    {
+        bool released = false;
+        {
+            std::lock_guard<std::mutex> lock(commitMutex);
+            released = releaseHoldLocked(holdId);
+        }
+        if (released)
+            capacityFreed(holds[holdId].room, holds[holdId].room, holds[holdId].start, holds[holdId].end);
+    }
+
+    /**
+     * @brief Advances the hold clock, releasing every hold that expires on the way.
+     *
+     * Confirmed and released holds are skipped when their timer fires, so expiry is O(1) per hold.
+     *
+     * @param now New tick (the clock never moves backwards)
+     */
+    void AdvanceClock(std::uint64_t now)
+    {
+        std::vector<int> expired;
+        {
+            std::lock_guard<std::mutex> lock(commitMutex);
+            holdTimers.Advance(now, [this, &expired](int holdId)
+                               {
+                if (releaseHoldLocked(holdId))
+                    expired.push_back(holdId); });
+        }
+        for (int holdId : expired)
+        {
+            capacityFreed(holds[holdId].room, holds[holdId].room, holds[holdId].start, holds[holdId].end);
+        }
+    }
+
+    /**
+     * @brief Cancels an active booking, freeing its room-days.
+     *
+     * Waitlisted requests overlapping the freed days are retried, in arrival order.
+     *
+     * @param bookingId Booking id, as returned by Book_V3
+     * @return "Accept" if the booking was cancelled, "Decline" if it was not active
+     */
+    std::string Cancel(int bookingId)
+    {
+        {
+            std::lock_guard<std::mutex> lock(commitMutex);
+            if (bookingId < 0 || bookingId >= ledger.size() || !ledger[bookingId].active)
+                return "Decline";
+            releaseLocked_bs(bookingId);
+        }
+        capacityFreed(ledger[bookingId].room, ledger[bookingId].room, ledger[bookingId].start, ledger[bookingId].end);
+        return "Accept";
+    }
+
+    /**
+     * @brief Changes the period of an active booking, preferring to keep its room.
+     *
+     * First checks, with a single mask test, whether the room is free on the days the new period
+     * adds; if so the booking grows or shrinks in place. Otherwise a room free for the whole new
+     * period is selected as Book_V3 would, and the booking moves there in one commit. If neither
+     * works the booking is left unchanged. The booking keeps its id either way, and waitlisted
+     * requests overlapping any released days are retried.
+     *
+     * @tparam Policy Room-selection policy for the fallback (default: most utilized)
+     * @param bookingId Booking id, as returned by Book_V3
+     * @param newStart New start day (inclusive)
+     * @param newEnd New end day (inclusive)
+     * @return "Accept" if the booking now covers the new period, "Decline" otherwise
+     */
+    template <typename Policy = MostUtilizedPolicy>
+    std::string Modify(int bookingId, int newStart, int newEnd)
+    {
+        if (newStart < 0 || newEnd >= MaxDays || newStart > newEnd)
+            return "Decline";
+        if (bookingId < 0 || bookingId >= ledger.size() || !ledger[bookingId].active)
+            return "Decline";
+
+        const Reservation before = ledger[bookingId];
+        const Bitset oldMask = RangeMask(before.start, before.end);
+        const Bitset newMask = RangeMask(newStart, newEnd);
+        const Bitset added = newMask & ~oldMask;
+        if ((occupied_bs[before.room] & added).none())
+        {
+            std::lock_guard<std::mutex> lock(commitMutex);
+            Reservation &booking = ledger.mut(bookingId);
+            occupied_bs.mut(before.room) &= ~(oldMask & ~newMask);
+            occupied_bs.mut(before.room) |= added;
+            utilization.mut(before.room) += (newEnd - newStart) - (before.end - before.start);
+            booking.start = newStart;
+            booking.end = newEnd;
+            const int first = std::min(before.start, newStart);
+            const int last = std::max(before.end, newEnd);
+            occupancyRemoved(before.room, first, last);
+            occupancyAdded(before.room, first, last);
+        }
+        else
+        {
+            int chosenRoom = selectRoom_bs<Policy>(newStart, newEnd, 0, size);
+            if (chosenRoom == -1)
+                return "Decline";
+            std::lock_guard<std::mutex> lock(commitMutex);
+            relocateLocked_bs(bookingId, chosenRoom, newStart, newEnd);
+        }
+        if ((oldMask & ~newMask).any() || ledger[bookingId].room != before.room)
+            capacityFreed(before.room, before.room, before.start, before.end);
+        return "Accept";
+    }
+
+    /**
+     * @brief Closes rooms [firstRoom, lastRoom] for maintenance over [start, end].
+     *
+     * The days are marked occupied, so no request can take them, but they do not count towards
+     * utilization, so room selection for other requests is not distorted. Each room is updated
+     * with one word-wide OR of the period mask. Nothing is closed if any room has a booking or
+     * hold in the period (see BlackoutConflicts); days that are already closed may overlap.
+     *
+     * @param firstRoom First room to close
+     * @param lastRoom Last room to close (inclusive)
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @return "Accept" if the rooms were closed, "Decline" otherwise
+     */
+    std::string Blackout(int firstRoom, int lastRoom, int start, int end)
+    {
+        if (start < 0 || end >= MaxDays || start > end)
+            return "Decline";
+        if (firstRoom < 0 || lastRoom >= size || firstRoom > lastRoom)
+            return "Decline";
+
+        const Bitset mask = RangeMask(start, end);
+        std::lock_guard<std::mutex> lock(commitMutex);
+        for (int r = firstRoom; r <= lastRoom; ++r)
+        {
+            if ((occupied_bs[r] & ~blocked_bs[r] & mask).any())
+                return "Decline";
+        }
+        for (int r = firstRoom; r <= lastRoom; ++r)
+        {
+            occupied_bs.mut(r) |= mask;
+            blocked_bs.mut(r) |= mask;
+            occupancyAdded(r, start, end);
+        }
+        return "Accept";
+    }
+
+    /**
+     * @brief Finds the bookings and holds that stop a blackout of rooms [firstRoom, lastRoom] over [start, end].
+     *
+     * Rooms whose occupancy misses the period are skipped with a single mask test; only the
+     * bookings of the remaining rooms are checked. Holds are not listed per room, so the hold
+     * records are scanned only if some room in the range has held days in the period.
+     *
+     * @param firstRoom First room
+     * @param lastRoom Last room (inclusive)
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param holdIds If not null, receives the ids of the active holds overlapping the period, ascending
+     * @return Ids of the active bookings overlapping the period, by room
+     */
+    std::vector<int> BlackoutConflicts(int firstRoom, int lastRoom, int start, int end, std::vector<int> *holdIds = nullptr) const
+    {
+        std::vector<int> conflicts;
+        if (holdIds)
+            holdIds->clear();
+        if (start < 0 || end >= MaxDays || start > end)
+            return conflicts;
+        const Bitset mask = RangeMask(start, end);
+        firstRoom = std::max(firstRoom, 0);
+        lastRoom = std::min(lastRoom, size - 1);
+        bool anyHeld = false;
+        for (int r = firstRoom; r <= lastRoom; ++r)
+        {
+            if ((occupied_bs[r] & ~blocked_bs[r] & mask).none())
+                continue;
+            anyHeld = anyHeld || (held_bs[r] & mask).any();
+            for (int id : roomBookings[r])
+            {
+                const Reservation &booking = ledger[id];
+                if (booking.start <= end && booking.end >= start)
+                    conflicts.push_back(id);
+            }
+        }
+        if (holdIds && anyHeld)
+        {
+            for (int id = 0; id < holds.size(); ++id)
+            {
+                const HoldRecord &hold = holds[id];
+                if (hold.active && hold.room >= firstRoom && hold.room <= lastRoom && hold.start <= end && hold.end >= start)
+                    holdIds->push_back(id);
+            }
+        }
+        return conflicts;
+    }
+
+    /**
+     * @brief Reopens the closed days of rooms [firstRoom, lastRoom] within [start, end].
+     *
+     * Retired rooms stay closed. Waitlisted requests overlapping the reopened days are retried.
+     *
+     * @param firstRoom First room to reopen
+     * @param lastRoom Last room to reopen (inclusive)
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     */
+    void LiftBlackout(int firstRoom, int lastRoom, int start, int end)
+    {
+        if (start < 0 || end >= MaxDays || start > end)
+            return;
+        const Bitset mask = RangeMask(start, end);
+        firstRoom = std::max(firstRoom, 0);
+        lastRoom = std::min(lastRoom, size - 1);
+        bool lifted = false;
+        {
+            std::lock_guard<std::mutex> lock(commitMutex);
+            for (int r = firstRoom; r <= lastRoom; ++r)
+            {
+                const Bitset closed = blocked_bs[r] & mask;
+                if (closed.none() || retired[r])
+                    continue;
+                blocked_bs.mut(r) &= ~closed;
+                occupied_bs.mut(r) &= ~closed;
+                occupancyRemoved(r, start, end);
+                lifted = true;
+            }
+        }
+        if (lifted)
+            capacityFreed(firstRoom, lastRoom, start, end);
+    }
+
+    /**
+     * @brief Loads existing reservations with known rooms, all or none (bitset-based).
+     *
+     * Meant for startup from a reservation dump. Reservations are bucketed by room, and each room's
+     * new days are OR-ed into one mask and checked against its occupancy with a single test, in
+     * parallel over pages of rooms. If every reservation fits, the masks are written in a second
+     * parallel pass, utilization is recomputed by popcount and the ledger is appended in input
+     * order. Subscriptions are refreshed once at the end. Rooms are never re-selected, so the
+     * result matches the dump exactly.
+     *
+     * @param reservations Reservations to load; inactive ones are recorded in the ledger without occupying their room
+     * @param firstBookingId If not null, receives the id of the first reservation (the others follow in order)
+     * @return "Accept" if all reservations were loaded, "Decline" if any is invalid or overlaps another
+     */
+    std::string BulkLoad(const std::vector<Reservation> &reservations, int *firstBookingId = nullptr)
+    {
+        const int n = static_cast<int>(reservations.size());
+        std::lock_guard<std::mutex> lock(commitMutex);
+
+        // Bucket the active reservations by room (counting sort, stable in input order)
+        std::vector<int> offsets(size + 1, 0);
+        for (const Reservation &booking : reservations)
+        {
+            if (!booking.active)
+                continue;
+            if (booking.room < 0 || booking.room >= size || booking.start < 0 || booking.end >= MaxDays || booking.start > booking.end)
+                return "Decline";
+            ++offsets[booking.room + 1];
+        }
+        for (int r = 0; r < size; ++r)
+        {
+            offsets[r + 1] += offsets[r];
+        }
+        std::vector<int> byRoom(offsets[size]);
+        std::vector<int> next(offsets.begin(), offsets.end() - 1);
+        for (int i = 0; i < n; ++i)
+        {
+            if (reservations[i].active)
+                byRoom[next[reservations[i].room]++] = i;
+        }
+
+        // Pass 1: build each room's mask of new days and check it
+        std::vector<Bitset> added(size);
+        std::atomic<bool> conflict(false);
+        parallelOverRooms(size, [&](int firstRoom, int lastRoom)
+                          {
+            for (int r = firstRoom; r < lastRoom && !conflict.load(std::memory_order_relaxed); ++r)
+            {
+                Bitset days;
+                for (int k = offsets[r]; k < offsets[r + 1]; ++k)
+                {
+                    const Reservation &booking = reservations[byRoom[k]];
+                    const Bitset mask = RangeMask(booking.start, booking.end);
+                    if ((days & mask).any())
+                        conflict = true;
+                    days |= mask;
+                }
+                if ((occupied_bs[r] & days).any())
+                    conflict = true;
+                added[r] = days;
+            } });
+        if (conflict)
+            return "Decline";
+
+        // Detach only the pages that will be written (some room on them gets bookings), so the
+        // workers never copy a shared page and pages shared with snapshots or forks stay shared
+        const int firstId = ledger.size();
+        for (int r = 0; r < size; r += PagedArray<Bitset>::PageSize)
+        {
+            if (offsets[r] == offsets[std::min(r + PagedArray<Bitset>::PageSize, size)])
+                continue;
+            occupied_bs.mut(r);
+            utilization.mut(r);
+            roomBookings.mut(r);
+        }
+        ledger.resize(firstId + n, Reservation());
+        for (int i = 0; i < n; ++i)
+        {
+            ledger.mut(firstId + i) = reservations[i];
+        }
+
+        // Pass 2: write the masks and recount utilization
+        parallelOverRooms(size, [&](int firstRoom, int lastRoom)
+                          {
+            for (int r = firstRoom; r < lastRoom; ++r)
+            {
+                if (offsets[r] == offsets[r + 1])
+                    continue;
+                Bitset &occupied = occupied_bs.mut(r);
+                occupied |= added[r];
+                utilization.mut(r) = static_cast<int>((occupied & ~held_bs[r] & ~blocked_bs[r]).count());
+                std::vector<int> &ids = roomBookings.mut(r);
+                for (int k = offsets[r]; k < offsets[r + 1]; ++k)
+                {
+                    ids.push_back(firstId + byRoom[k]);
+                }
+            } });
+
+        for (int r = 0; r < size; ++r)
+        {
+            if (offsets[r] != offsets[r + 1])
+                mirrorRoomLocked_bf(r);
+        }
+        refreshSubscriptionsLocked();
+        if (firstBookingId)
+            *firstBookingId = firstId;
+        return "Accept";
+    }
+
+    /**
+     * @brief Books through the active engine (see SwitchEngine).
+     *
+     * Every engine records its bookings in the bitset state and the ledger, which stay the source
+     * of truth, so cancellations, holds and every other bitset-side operation keep working and
+     * are mirrored into the rows the brute-force engines select from. Brute-force engines run
+     * under the commit lock. Call from the booking thread; a finished background switch is
+     * installed here, between two requests.
+     *
+     * @tparam Policy Room-selection policy (default: most utilized)
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param bookingId If not null, receives the id of the booking
+     * @return "Accept" if booking is successful, "Decline" otherwise
+     */
+    template <typename Policy = MostUtilizedPolicy>
+    std::string Reserve(int start, int end, int *bookingId = nullptr)
+    {
+        if (switchReady.load())
+            FinishSwitchEngine();
+        switch (activeEngine.load())
+        {
+        case BookingEngine::BruteForce:
+            if (start < 0 || end >= MaxDays || start > end)
+                return "Decline";
+            return book_bf(start, end, [this, start, end]
+                           { return selectRoom_bf<Policy>(start, end); }, nullptr, bookingId);
+        case BookingEngine::Heap:
+            if (start < 0 || end >= MaxDays || start > end)
+                return "Decline";
+            return book_bf(start, end, [this, start, end]
+                           { return selectRoomHeap_bf<Policy>(start, end); }, nullptr, bookingId);
+        default:
+            return Book_V3<Policy>(start, end, bookingId);
+        }
+    }
+
+    /**
+     * @brief Turns cross-checking of the Book/Book_V2 utilization counters on or off.
+     *
+     * When on, every counter read is compared with a popcount of the room's row (restoring the
+     * old O(days) cost), and disagreements are counted in UtilizationMismatches.
+     *
+     * @param enabled True to cross-check
+     */
+    void SetVerifyUtilization(bool enabled)
+    {
+        verifyUtilization_bf = enabled;
+    }
+
+    /**
+     * @brief Returns the number of Book/Book_V2 utilization reads that disagreed with a recount.
+     */
+    long long UtilizationMismatches() const
+    {
+        return utilizationMismatches_bf.load();
+    }
+
+    /**
+     * @brief Returns the engine Reserve dispatches to.
+     */
+    BookingEngine ActiveEngine() const
+    {
+        return activeEngine.load();
+    }
+
+    /**
+     * @brief Starts switching Reserve to another engine, converting the state in the background.
+     *
+     * The bitset state is always complete, so switching back to Book_V3 (or between Book and
+     * Book_V2) flips at once. Switching to Book or Book_V2 needs their rows: the bitset state is
+     * copied (O(1), pages are shared copy-on-write) and split into booked days (occupied_bf, which
+     * count as utilization) and held or blocked days (closed_bf) on a background thread while
+     * Reserve keeps using the current engine. The switch is installed by FinishSwitchEngine, or by
+     * the next Reserve once the conversion is done: rooms whose pages were written since the copy
+     * (detected by page identity) are converted again, and then the engine flips. From then on the
+     * occupancy hooks keep the rows in step with every bitset-side change, and direct Book and
+     * Book_V2 calls commit to the bitset state too. Rows written by direct Book or Book_V2 calls
+     * before the switch (while Book_V3 was active) are replaced by the converted bitset state.
+     *
+     * @param target Engine to switch to
+     * @return "Accept" if the switch started (or completed), "Decline" if another switch is pending
+     */
+    std::string BeginSwitchEngine(BookingEngine target)
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        if (switchWorker.joinable())
+            return "Decline";
+        if (UsesBruteForceState(target) == UsesBruteForceState(activeEngine.load()))
+        {
+            activeEngine = target;
+            return "Accept";
+        }
+        switchTarget = target;
+        switchSource_bs = occupied_bs;
+        switchSourceHeld_bs = held_bs;
+        switchSourceBlocked_bs = blocked_bs;
+        switchReady = false;
+        switchWorker = std::thread(&Hotel::convertForSwitch, this);
+        return "Accept";
+    }
+
+    /**
+     * @brief Waits for a pending engine switch and installs it. Does nothing if none is pending.
+     *
+     * Call from the booking thread.
+     */
+    void FinishSwitchEngine()
+    {
+        if (!switchWorker.joinable())
+            return;
+        switchWorker.join();
+        std::lock_guard<std::mutex> lock(commitMutex);
+        converted_bf.resize(size, Row_bf());
+        convertedClosed_bf.resize(size, Row_bf());
+        for (int r = 0; r < size; ++r)
+        {
+            if (occupied_bs.SharesPage(switchSource_bs, r) && held_bs.SharesPage(switchSourceHeld_bs, r) &&
+                blocked_bs.SharesPage(switchSourceBlocked_bs, r))
+                continue;
+            const Bitset closed = held_bs[r] | blocked_bs[r];
+            converted_bf.mut(r) = ToRow_bf(occupied_bs[r] & ~closed);
+            convertedClosed_bf.mut(r) = ToRow_bf(closed);
+        }
+        occupied_bf = converted_bf;
+        closed_bf = convertedClosed_bf;
+        utilization_bf = utilization;
+        activeEngine = switchTarget;
+        switchSource_bs = PagedArray<Bitset>();
+        switchSourceHeld_bs = PagedArray<Bitset>();
+        switchSourceBlocked_bs = PagedArray<Bitset>();
+        converted_bf = PagedArray<Row_bf>();
+        convertedClosed_bf = PagedArray<Row_bf>();
+        switchReady = false;
+    }
+
+    /**
+     * @brief Switches Reserve to another engine, converting the state before returning.
+     * @param target Engine to switch to
+     * @return "Accept" once switched, "Decline" if another switch is pending
+     */
+    std::string SwitchEngine(BookingEngine target)
+    {
+        if (BeginSwitchEngine(target) != "Accept")
+            return "Decline";
+        FinishSwitchEngine();
+        return "Accept";
+    }
+
+    /**
+     * @brief Opens n new empty rooms without rebuilding the hotel.
+     *
+     * The rooms join the last category and get the next room numbers. Per-room state grows by
+     * appending pages (existing pages, and snapshots or forks that share them, are not copied), and
+     * sold-out subscriptions and waitlisted requests are updated as if the new rooms' days had just
+     * been freed.
+     *
+     * @param n Number of rooms to add
+     * @return Number of the first new room, or -1 if n is not positive
+     */
+    int AddRooms(int n)
+    {
+        if (n <= 0)
+            return -1;
+        int first = 0;
+        {
+            std::lock_guard<std::mutex> lock(commitMutex);
+            first = size;
+            growRooms(size + n);
+            if (categories.empty())
+                categories.push_back({"Standard", first, 0});
+            categories.back().count += n;
+            for (int r = first; r < size; ++r)
+            {
+                occupancyRemoved(r, 0, MaxDays - 1);
+            }
+        }
+        capacityFreed(first, first + n - 1, 0, MaxDays - 1);
+        return first;
+    }
+
+    /**
+     * @brief Takes a room out of service for good.
+     *
+     * The room keeps its number (so booking ids and room numbers stay valid) but all its days
+     * are closed as a blackout that LiftBlackout does not reopen. A room with active bookings or
+     * holds cannot be retired; move or cancel them first.
+     *
+     * @param room Room index
+     * @return "Accept" if the room was retired, "Decline" otherwise
+     */
+    std::string RetireRoom(int room)
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        if (room < 0 || room >= size || retired[room])
+            return "Decline";
+        if ((occupied_bs[room] & ~blocked_bs[room]).any())
+            return "Decline";
+        retired.mut(room) = true;
+        occupied_bs.mut(room).set();
+        blocked_bs.mut(room).set();
+        occupancyAdded(room, 0, MaxDays - 1);
+        return "Accept";
+    }
+
+    /**
+     * @brief Returns true if a room was retired by RetireRoom.
+     * @param room Room index
+     */
+    bool IsRetired(int room) const
+    {
+        return retired[room];
+    }
+
+    /**
+     * @brief Adds a request to the waitlist, booking it at once if a room is free.
+     *
+     * The request is first tried with Book_V3; if that accepts, the entry is created already
+     * promoted. Otherwise it waits and is booked automatically when a cancellation, release, hold
+     * expiry or repair move frees days overlapping it, in the freed room (or the one Book_V3 would
+     * pick among several freed rooms), with earlier entries served first. Because every waiting
+     * entry was declined, only freed rooms ever need to be tried.
+     *
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @return Waitlist id, or -1 for an invalid period
+     */
+    int JoinWaitlist(int start, int end)
+    {
+        if (start < 0 || end >= MaxDays || start > end)
+            return -1;
+        WaitlistEntry entry;
+        entry.start = start;
+        entry.end = end;
+        entry.waiting = Book_V3(start, end, &entry.bookingId) != "Accept";
+        int id = static_cast<int>(waitlist.size());
+        waitlist.push_back(entry);
+        if (entry.waiting)
+            waitlistIndex.Insert(id, start, end);
+        return id;
+    }
+
+    /**
+     * @brief Withdraws a request from the waitlist. Does nothing if it is no longer waiting.
+     * @param waitlistId Waitlist id, as returned by JoinWaitlist
+     */
+    void LeaveWaitlist(int waitlistId)
+    {
+        if (waitlistId < 0 || waitlistId >= static_cast<int>(waitlist.size()) || !waitlist[waitlistId].waiting)
+            return;
+        waitlist[waitlistId].waiting = false;
+        waitlistIndex.Erase(waitlistId);
+    }
+
+    /**
+     * @brief Returns a waitlist entry, including the booking made if it was promoted.
+     * @param waitlistId Waitlist id, as returned by JoinWaitlist
+     */
+    WaitlistEntry GetWaitlistEntry(int waitlistId) const
+    {
+        return waitlist[waitlistId];
+    }
+
+    /**
+     * @brief Subscribes to availability changes for a period.
+     *
+     * Every later commit, cancellation, hold or release that flips the period between available
+     * (some room free for all of it) and sold out queues an AvailabilityNotice; changes that do
+     * not flip the state are not reported.
+     *
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param available If not null, receives the current state
+     * @return Subscription id, or -1 for an invalid period
+     */
+    int Subscribe(int start, int end, bool *available = nullptr)
+    {
+        if (start < 0 || end >= MaxDays || start > end)
+            return -1;
+        std::lock_guard<std::mutex> lock(commitMutex);
+        Subscription subscription;
+        subscription.start = start;
+        subscription.end = end;
+        subscription.witness = firstFreeRoom_bs(start, end);
+        subscription.available = subscription.witness != -1;
+        subscription.active = true;
+        int id = static_cast<int>(subscriptions.size());
+        subscriptions.push_back(subscription);
+        subscriptionIndex.Insert(id, start, end);
+        if (available)
+            *available = subscription.available;
+        return id;
+    }
+
+    /**
+     * @brief Stops notifications for a subscription.
+     * @param subscriptionId Subscription id, as returned by Subscribe
+     */
+    void Unsubscribe(int subscriptionId)
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        if (subscriptionId < 0 || subscriptionId >= static_cast<int>(subscriptions.size()) || !subscriptions[subscriptionId].active)
+            return;
+        subscriptions[subscriptionId].active = false;
+        subscriptionIndex.Erase(subscriptionId);
+    }
+
+    /**
+     * @brief Takes the next availability notice. Call from a single consumer thread.
+     * @param notice Receives the notice
+     * @return False if no notice is waiting
+     */
+    bool PollNotification(AvailabilityNotice &notice)
+    {
+        return notices.TryPop(notice);
+    }
+
+    /**
+     * @brief Returns the number of notices dropped because the consumer fell behind.
+     */
+    long long DroppedNotifications() const
+    {
+        return droppedNotices.load();
+    }
+
+    /**
+     * @brief Returns a booking from the ledger of the bitset engine.
+     * @param id Booking id, as returned by Book_V3
+     * @return The booking's room and period, and whether it is still active
+     */
+    Reservation GetBooking(int id) const
+    {
+        return ledger[id];
+    }
+
+    /**
+     * @brief Book_V3 with an optional repair step that reshuffles existing bookings to fit a declined stay.
+     *
+     * If no room is free for [start, end], looks for a room whose conflicting bookings (at most
+     * maxMoves of them) can each be moved to another room that is free for their own period. This
+     * is a bounded, depth-one augmenting-path search: moved bookings never displace others. The
+     * candidate rooms are scored under the policy as Book_V3 would score them once their
+     * conflicting bookings are gone (utilization without them, and the gap around the stay for
+     * BestFitGap), and tried best first, so the stay lands in the best room that can be repaired
+     * within the budget. The clock is read every RepairClockStride rooms, both while collecting
+     * candidates and while searching destinations, so the search stops within a few dozen room
+     * checks of the budget running out, and nothing is changed unless a complete set of moves is
+     * found. Moved bookings keep their ids.
+     *
+     * @tparam Policy Room-selection policy (default: most utilized)
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param maxMoves Maximum number of existing bookings to move
+     * @param budget Maximum time to spend on the repair search
+     * @param bookingId If not null, receives the id of the accepted booking
+     * @return "Accept" if booking is successful, "Decline" otherwise
+     */
+    template <typename Policy = MostUtilizedPolicy>
+    std::string BookWithRepair(int start, int end, int maxMoves, std::chrono::microseconds budget, int *bookingId = nullptr)
+    {
+        if (Book_V3<Policy>(start, end, bookingId) == "Accept")
+            return "Accept";
+        if (start < 0 || end >= MaxDays || start > end)
+            return "Decline";
+
+        const auto deadline = std::chrono::steady_clock::now() + budget;
+        const Bitset mask = RangeMask(start, end);
+
+        // Rooms whose overlapping bookings (at most maxMoves) could all move out, scored as Book_V3
+        // would score them once those bookings are gone
+        struct Candidate
+        {
+            int score;
+            int room;
+            std::vector<int> conflicts;
+        };
+        std::vector<Candidate> candidates;
+        for (int r = 0; r < size; ++r)
+        {
+            if (r % RepairClockStride == 0 && std::chrono::steady_clock::now() >= deadline)
+                break;
+            Candidate candidate{0, r, {}};
+            Bitset conflictDays;
+            int conflictNights = 0;
+            bool tooMany = false;
+            for (int id : roomBookings[r])
+            {
+                const Reservation &booking = ledger[id];
+                if (booking.start > end || booking.end < start)
+                    continue;
+                if (static_cast<int>(candidate.conflicts.size()) == maxMoves)
+                {
+                    tooMany = true;
+                    break;
+                }
+                candidate.conflicts.push_back(id);
+                conflictDays |= RangeMask(booking.start, booking.end);
+                conflictNights += booking.end - booking.start + 1;
+            }
+            const Bitset remaining = occupied_bs[r] & ~conflictDays;
+            if (tooMany || (remaining & mask).any())
+                continue;
+            const int gap = Policy::UsesGap ? (start - PrevSetDay(remaining, start) - 1) + (NextSetDay(remaining, end) - end - 1) : 0;
+            candidate.score = Policy::Score(utilization[r] - conflictNights, gap);
+            candidates.push_back(std::move(candidate));
+        }
+        // Best first, lowest room number on ties, so the first repairable candidate is the one Book_V3 would pick
+        std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b)
+                         { return a.score > b.score; });
+
+        bool expired = false;
+        for (const Candidate &candidate : candidates)
+        {
+            if (expired || std::chrono::steady_clock::now() >= deadline)
+                break;
+            const int r = candidate.room;
+            const std::vector<int> &conflicts = candidate.conflicts;
+
+            // Find a destination for each conflict, accounting for the moves planned so far
+            std::vector<std::pair<int, Bitset>> planned; // (destination room, days added)
+            std::vector<int> targets;
+            int scanned = 0;
+            for (int id : conflicts)
+            {
+                const Reservation &booking = ledger[id];
+                const Bitset bookingMask = RangeMask(booking.start, booking.end);
+                int target = -1;
+                int bestScore = 0;
+                for (int t = 0; t < size; ++t)
+                {
+                    if (++scanned % RepairClockStride == 0 && std::chrono::steady_clock::now() >= deadline)
+                    {
+                        expired = true;
+                        break;
+                    }
+                    if (t == r)
+                        continue;
+                    Bitset occupied = occupied_bs[t];
+                    for (const auto &move : planned)
+                    {
+                        if (move.first == t)
+                            occupied |= move.second;
+                    }
+                    if ((occupied & bookingMask).any())
+                        continue;
+                    int score = score_bs<Policy>(t, booking.start, booking.end);
+                    if (target == -1 || score > bestScore)
+                    {
+                        target = t;
+                        bestScore = score;
+                        if (Policy::TakeFirst)
+                            break;
+                    }
+                }
+                if (expired || target == -1)
+                    break;
+                planned.push_back({target, bookingMask});
+                targets.push_back(target);
+            }
+            if (targets.size() != conflicts.size())
+                continue;
+
+            for (size_t i = 0; i < conflicts.size(); ++i)
+            {
+                move_bs(conflicts[i], targets[i]);
+            }
+            int id = commit_bs(r, start, end);
+            if (bookingId)
+                *bookingId = id;
+            // The moved bookings' days in r that the new stay does not cover are free now
+            for (int moved : conflicts)
+                capacityFreed(r, r, ledger[moved].start, ledger[moved].end);
+            return "Accept";
+        }
+        return "Decline";
+    }
+
+    /**
+     * @brief Verify with a fresh sample on every call.
+     *
+     * Sampled checks are seeded from a per-hotel call counter, so successive calls cover
+     * different rooms.
+     *
+     * @param sampleRooms Number of random rooms to check, or 0 for a full check
+     * @return Rooms checked and the inconsistencies found
+     */
+    ConsistencyReport Verify(int sampleRooms = 0) const
+    {
+        return Verify(sampleRooms, sampleRooms > 0 ? verifySamples++ : 0);
+    }
+
+    /**
+     * @brief Checks the acceleration state against the raw occupancy.
+     *
+     * Works on copy-on-write copies taken under the commit lock (O(1) each), so bookings continue
+     * while rooms are checked in parallel over pages. For each room, the bitset masks must be
+     * consistent (held and blocked days are disjoint occupied days, a retired room is fully
+     * blocked), utilization must equal the popcount of the booked days, the room's booking list
+     * must tile exactly those days with active ledger entries, and the Book/Book_V2 counter must
+     * equal the popcount of its row. While Reserve uses Book or Book_V2, the room's brute-force
+     * rows must also mirror its booked days and its held or blocked days. A full check also
+     * matches the ledger and the holds against the rooms, every active hold against a pending
+     * expiry timer, the waitlist and subscription interval indexes against the waiting entries
+     * and active subscriptions, and checks every subscription's state; a sampled check covers
+     * only the rooms. The waitlist is not guarded by the commit lock, so a full check must run on
+     * the thread that joins, leaves and (through Cancel, Release and AdvanceClock) promotes
+     * waitlist entries.
+     *
+     * @param sampleRooms Number of random rooms to check, or 0 for a full check
+     * @param seed Seed for choosing the sample (vary it between calls to cover every room over time)
+     * @return Rooms checked and the inconsistencies found
+     */
+    ConsistencyReport Verify(int sampleRooms, std::uint32_t seed) const
+    {
+        const bool full = sampleRooms <= 0 || sampleRooms >= size;
+        int rooms = 0;
+        PagedArray<Bitset> occupied, held, blocked;
+        PagedArray<int> booked, booked_bf;
+        PagedArray<bool> retiredRooms;
+        PagedArray<Reservation> bookings;
+        PagedArray<std::vector<int>> bookingsByRoom;
+        PagedArray<HoldRecord> holdRecords;
+        PagedArray<Row_bf> rows_bf, closedRows_bf;
+        bool mirrored = false;
+        std::vector<Subscription> watches;
+        IntervalIndex watchIndex(0);
+        TimerWheel timers;
+        {
+            std::lock_guard<std::mutex> lock(commitMutex);
+            rooms = size;
+            occupied = occupied_bs;
+            held = held_bs;
+            blocked = blocked_bs;
+            booked = utilization;
+            booked_bf = utilization_bf;
+            retiredRooms = retired;
+            bookings = ledger;
+            bookingsByRoom = roomBookings;
+            holdRecords = holds;
+            rows_bf = occupied_bf;
+            closedRows_bf = closed_bf;
+            mirrored = UsesBruteForceState(activeEngine.load());
+            if (full)
+            {
+                watches = subscriptions;
+                watchIndex = subscriptionIndex;
+                timers = holdTimers;
+            }
+        }
+
+        ConsistencyReport report;
+        std::vector<int> checked;
+        if (full)
+        {
+            checked.resize(rooms);
+            for (int r = 0; r < rooms; ++r)
+                checked[r] = r;
+        }
+        else
+        {
+            // Floyd's algorithm: sampleRooms distinct rooms, each subset equally likely
+            std::mt19937 rng(seed);
+            std::set<int> picked;
+            for (int j = rooms - sampleRooms; j < rooms; ++j)
+            {
+                int t = std::uniform_int_distribution<int>(0, j)(rng);
+                if (!picked.insert(t).second)
+                    picked.insert(j);
+            }
+            checked.assign(picked.begin(), picked.end());
+        }
+        report.roomsChecked = static_cast<int>(checked.size());
+
+        auto roomConsistent = [&](int r)
+        {
+            const Bitset &occupiedDays = occupied[r];
+            const Bitset &heldDays = held[r];
+            const Bitset &blockedDays = blocked[r];
+            if ((heldDays & ~occupiedDays).any() || (blockedDays & ~occupiedDays).any() || (heldDays & blockedDays).any())
+                return false;
+            if (retiredRooms[r] && !blockedDays.all())
+                return false;
+            const Bitset bookedDays = occupiedDays & ~heldDays & ~blockedDays;
+            if (booked[r] != static_cast<int>(bookedDays.count()))
+                return false;
+            Bitset listed;
+            for (int id : bookingsByRoom[r])
+            {
+                if (id < 0 || id >= bookings.size())
+                    return false;
+                const Reservation &booking = bookings[id];
+                if (!booking.active || booking.room != r)
+                    return false;
+                const Bitset mask = RangeMask(booking.start, booking.end);
+                if ((listed & mask).any())
+                    return false;
+                listed |= mask;
+            }
+            if (listed != bookedDays)
+                return false;
+            int count_bf = 0;
+            for (std::uint64_t word : rows_bf[r])
+                count_bf += PopCount(word);
+            if (booked_bf[r] != count_bf)
+                return false;
+            return !mirrored || (rows_bf[r] == ToRow_bf(bookedDays) && closedRows_bf[r] == ToRow_bf(heldDays | blockedDays));
+        };
+
+        std::mutex resultMutex;
+        parallelOverRooms(report.roomsChecked, [&](int first, int last)
+                          {
+            std::vector<int> bad;
+            for (int i = first; i < last; ++i)
+            {
+                if (!roomConsistent(checked[i]))
+                    bad.push_back(checked[i]);
+            }
+            std::lock_guard<std::mutex> lock(resultMutex);
+            report.badRooms.insert(report.badRooms.end(), bad.begin(), bad.end()); });
+        std::sort(report.badRooms.begin(), report.badRooms.end());
+        if (!full)
+            return report;
+
+        // Every active booking is listed by exactly one room (rooms list only active, matching bookings)
+        long long activeBookings = 0;
+        long long listedBookings = 0;
+        for (int id = 0; id < bookings.size(); ++id)
+        {
+            if (bookings[id].active)
+                ++activeBookings;
+        }
+        for (int r = 0; r < rooms; ++r)
+            listedBookings += static_cast<long long>(bookingsByRoom[r].size());
+        if (activeBookings != listedBookings)
+            ++report.globalViolations;
+
+        // Active holds exactly cover the held days
+        long long heldNights = 0;
+        long long holdNights = 0;
+        for (int r = 0; r < rooms; ++r)
+            heldNights += static_cast<long long>(held[r].count());
+        for (int id = 0; id < holdRecords.size(); ++id)
+        {
+            const HoldRecord &hold = holdRecords[id];
+            if (!hold.active)
+                continue;
+            holdNights += hold.end - hold.start + 1;
+            if (hold.room < 0 || hold.room >= rooms || (RangeMask(hold.start, hold.end) & ~held[hold.room]).any())
+                ++report.globalViolations;
+        }
+        if (heldNights != holdNights)
+            ++report.globalViolations;
+
+        // Every active hold has a pending expiry timer (timers of finished holds may linger)
+        const std::vector<std::pair<int, std::uint64_t>> pending = timers.Pending();
+        for (int id = 0; id < holdRecords.size(); ++id)
+        {
+            const HoldRecord &hold = holdRecords[id];
+            if (!hold.active)
+                continue;
+            auto timer = std::lower_bound(pending.begin(), pending.end(), std::make_pair(id, hold.expiry));
+            if (timer == pending.end() || timer->first != id || timer->second <= timers.Now())
+                ++report.globalViolations;
+        }
+        for (const std::pair<int, std::uint64_t> &timer : pending)
+        {
+            if (timer.first < 0 || timer.first >= holdRecords.size())
+                ++report.globalViolations;
+        }
+
+        // The interval indexes hold exactly the waiting entries and the active subscriptions
+        auto indexMatches = [](const IntervalIndex &index, int count, std::function<bool(int, int &, int &)> entry)
+        {
+            if (!index.Consistent())
+                return false;
+            std::vector<int> expected;
+            for (int id = 0; id < count; ++id)
+            {
+                int start = 0, end = 0;
+                if (!entry(id, start, end))
+                    continue;
+                expected.push_back(id);
+                if (index.Range(id) != std::make_pair(start, end))
+                    return false;
+            }
+            return index.Overlapping(0, MaxDays - 1) == expected;
+        };
+        if (!indexMatches(waitlistIndex, static_cast<int>(waitlist.size()), [this](int id, int &start, int &end)
+                          {
+                const WaitlistEntry &entry = waitlist[id];
+                start = entry.start;
+                end = entry.end;
+                return entry.waiting; }))
+            ++report.globalViolations;
+        if (!indexMatches(watchIndex, static_cast<int>(watches.size()), [&watches](int id, int &start, int &end)
+                          {
+                const Subscription &subscription = watches[id];
+                start = subscription.start;
+                end = subscription.end;
+                return subscription.active; }))
+            ++report.globalViolations;
+
+        // Available subscriptions have a free witness room; sold-out ones have no free room
+        for (const Subscription &subscription : watches)
+        {
+            if (!subscription.active)
+                continue;
+            const Bitset mask = RangeMask(subscription.start, subscription.end);
+            if (subscription.available)
+            {
+                if (subscription.witness < 0 || subscription.witness >= rooms || (occupied[subscription.witness] & mask).any())
+                    ++report.globalViolations;
+                continue;
+            }
+            for (int r = 0; r < rooms; ++r)
+            {
+                if ((occupied[r] & mask).none())
+                {
+                    ++report.globalViolations;
+                    break;
+                }
+            }
+        }
+        return report;
+    }
+
+    /**
+     * @brief Takes a consistent snapshot of the bitset state for concurrent reads.
+     *
+     * Safe to call from any thread while bookings are being made; the commit lock is held only
+     * while the page directories are copied.
+     *
+     * @return Snapshot reflecting every booking committed before the call
+     */
+    Snapshot GetSnapshot() const
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        return Snapshot(size, occupied_bs, utilization);
+    }
+
+    /**
+     * @brief Forks the hotel state for what-if simulation.
+     *
+     * The branch shares every room page with this hotel copy-on-write, so forking is O(1) and each
+     * side copies only the pages it later writes. Pending hold timers are shared the same way, one
+     * wheel level per page; the waitlist and subscriptions stay with this hotel. Branches are
+     * independent Hotels and can run on other threads. Safe to call concurrently with Book_V3;
+     * Book and Book_V2 must not run concurrently with a fork of the same hotel.
+     *
+     * @return New Hotel with the same bookings as this one
+     */
+    std::unique_ptr<Hotel> Fork() const
+    {
+        std::unique_ptr<Hotel> branch(new Hotel(0));
+        std::lock_guard<std::mutex> lock(commitMutex);
+        branch->size = size;
+        branch->occupied_bf = occupied_bf;
+        branch->utilization_bf = utilization_bf;
+        branch->closed_bf = closed_bf;
+        branch->verifyUtilization_bf = verifyUtilization_bf;
+        branch->occupied_bs = occupied_bs;
+        branch->utilization = utilization;
+        branch->ledger = ledger;
+        branch->roomBookings = roomBookings;
+        branch->held_bs = held_bs;
+        branch->blocked_bs = blocked_bs;
+        branch->retired = retired;
+        branch->holds = holds;
+        branch->holdTimers = holdTimers;
+        branch->categories = categories;
+        branch->floorMasks = floorMasks;
+        branch->activeEngine = activeEngine.load();
+        return branch;
+    }
+
+    /**
+     * @brief Finds the chain of rooms with the fewest room changes that covers [start, end].
+     *
+     * Used when Book_V3 declines but the guest accepts moving mid-stay. Works on per-day room
+     * masks: starting from the current day, the set of rooms that stay free is AND-ed with the
+     * next day's mask, 64 rooms per word, until it would become empty. Staying in a room that
+     * remains free the longest is optimal, so the chain has the fewest moves. Among those rooms,
+     * the most utilized (lowest room number on ties) is chosen. Nothing is booked.
+     *
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param maxMoves Maximum number of room changes the guest accepts
+     * @return Segments in day order, or an empty vector if no chain within maxMoves exists
+     */
+    std::vector<StaySegment> FindSplitStay(int start, int end, int maxMoves) const
+    {
+        std::vector<StaySegment> segments;
+        if (start < 0 || end >= MaxDays || start > end)
+            return segments;
+
+        const std::vector<RoomMask> freeByDay = freeRoomsByDay_bs(start, end);
+        const int words = (size + 63) / 64;
+        int day = start;
+        while (day <= end)
+        {
+            if (static_cast<int>(segments.size()) > maxMoves)
+                return std::vector<StaySegment>();
+
+            // Extend while some room stays free through the next day
+            RoomMask staying = freeByDay[day - start];
+            int last = day - 1;
+            while (last < end)
+            {
+                const RoomMask &next = freeByDay[last + 1 - start];
+                RoomMask both(words);
+                bool any = false;
+                for (int w = 0; w < words; ++w)
+                {
+                    both[w] = staying[w] & next[w];
+                    any = any || both[w] != 0;
+                }
+                if (!any)
+                    break;
+                staying.swap(both);
+                ++last;
+            }
+            if (last < day)
+                return std::vector<StaySegment>(); // No room is free on this day
+
+            int chosenRoom = -1;
+            for (int w = 0; w < words; ++w)
+            {
+                for (std::uint64_t bits = staying[w]; bits != 0; bits &= bits - 1)
+                {
+                    int r = 64 * w + LowestSetBit(bits);
+                    if (chosenRoom == -1 || utilization[r] > utilization[chosenRoom])
+                        chosenRoom = r;
+                }
+            }
+            segments.push_back({chosenRoom, day, last});
+            day = last + 1;
+        }
+        if (static_cast<int>(segments.size()) > maxMoves + 1)
+            return std::vector<StaySegment>();
+        return segments;
+    }
+
+    /**
+     * @brief Flexible-date search: finds the earliest start for a stay of a given length within a window.
+     *
+     * For each room, the free days are folded into "a run of length nights starts here" bits with
+     * O(log length) shift-and operations on the whole bitset, and the first such start in the
+     * window is found by a bit scan. Later rooms only search up to the best start found so far.
+     * Among rooms with the same earliest start, the most utilized (lowest room number on ties) is
+     * chosen, as in Book_V3. Nothing is booked.
+     *
+     * @param windowStart First day the stay may start (inclusive)
+     * @param windowEnd Last day the stay may end (inclusive)
+     * @param length Number of nights
+     * @return Room and period of the earliest fit, or room -1 if the stay fits nowhere in the window
+     */
+    StaySegment FindEarliest(int windowStart, int windowEnd, int length) const
+    {
+        StaySegment best = {-1, -1, -1};
+        if (length < 1 || windowStart < 0 || windowEnd >= MaxDays || windowStart + length - 1 > windowEnd)
+            return best;
+
+        int lastStart = windowEnd - length + 1;
+        for (int r = 0; r < size; ++r)
+        {
+            // Bit d of fits is set if days [d, d + covered - 1] are all free
+            Bitset fits = ~occupied_bs[r];
+            int covered = 1;
+            while (covered < length)
+            {
+                int step = std::min(covered, length - covered);
+                fits &= fits >> step;
+                covered += step;
+            }
+            int startDay = FirstSetDay(fits & RangeMask(windowStart, lastStart));
+            if (startDay > lastStart)
+                continue;
+            if (best.room == -1 || startDay < best.start || utilization[r] > utilization[best.room])
+            {
+                best = {r, startDay, startDay + length - 1};
+                lastStart = startDay; // Later rooms can only tie or lose beyond this start
+            }
+        }
+        return best;
+    }
+
+    /**
+     * @brief Offline assignment for batch imports where all stays are known up front.
+     *
+     * Each run of free days in a room (between existing bookings, holds or closed days) is a slot
+     * that stays can fill. Stays are taken in order of end day, and each goes to the slot whose
+     * last booked day is the latest one before the stay starts, among the slots still open on the
+     * stay's last day (slots are kept ordered by last booked day; on ties the slot that closes
+     * first, then the lowest room). On a hotel whose free days are open-ended runs (e.g. an empty
+     * hotel) this earliest-finish, best-fit rule is optimal for the number of stays accepted; with
+     * bounded gaps it is a greedy that stays close to it. It runs in O((n + slots) log slots)
+     * instead of n Book_V3 scans.
+     *
+     * @param stays (start, end) stays to import
+     * @return "Accept" or "Decline" for each stay, in the same order
+     */
+    std::vector<std::string> BookOffline(const std::vector<std::pair<int, int>> &stays)
+    {
+        const int n = static_cast<int>(stays.size());
+        std::vector<std::string> results(n, "Decline");
+        std::vector<int> order;
+        for (int i = 0; i < n; ++i)
+        {
+            if (stays[i].first >= 0 && stays[i].second < MaxDays && stays[i].first <= stays[i].second)
+                order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&stays](int a, int b)
+                         { return stays[a].second < stays[b].second; });
+
+        // (last booked day, last free day, room) for every run of free days in every room
+        using Slot = std::tuple<int, int, int>;
+        std::set<Slot> slots;
+        const Bitset everyDay = RangeMask(0, MaxDays - 1);
+        for (int r = 0; r < size; ++r)
+        {
+            const Bitset freeDays = ~occupied_bs[r] & everyDay;
+            int day = FirstSetDay(freeDays);
+            while (day < MaxDays)
+            {
+                const int lastFree = nextOccupied_bs(r, day) - 1;
+                slots.insert(Slot(day - 1, lastFree, r));
+                if (lastFree + 2 >= MaxDays)
+                    break;
+                day = FirstSetDay(freeDays & RangeMask(lastFree + 2, MaxDays - 1));
+            }
+        }
+
+        for (int i : order)
+        {
+            const int start = stays[i].first;
+            const int end = stays[i].second;
+            // Latest last booked day before start, dropping slots that close before end (ends only grow)
+            int latest = -2;
+            auto it = slots.lower_bound(Slot(start, -1, -1));
+            while (it != slots.begin())
+            {
+                --it;
+                if (std::get<1>(*it) < end)
+                {
+                    it = slots.erase(it);
+                    continue;
+                }
+                latest = std::get<0>(*it);
+                break;
+            }
+            if (latest == -2)
+                continue; // No slot is free for the whole stay
+            it = slots.lower_bound(Slot(latest, end, -1)); // Tightest slot, then lowest room, among equal fits
+            const int lastFree = std::get<1>(*it);
+            const int room = std::get<2>(*it);
+            slots.erase(it);
+            slots.insert(Slot(end, lastFree, room));
+            commit_bs(room, start, end);
+            results[i] = "Accept";
+        }
+        return results;
+    }
+
+    /**
+     * @brief Compares BookOffline with booking the same stays online through Book_V3.
+     *
+     * Both runs happen on forks of the current state, so both see the same existing bookings and
+     * every room, and this hotel is not modified.
+     *
+     * @param stays (start, end) stays in submission order
+     * @return Accepted stays and nights for each mode
+     */
+    OfflineComparison CompareOffline(const std::vector<std::pair<int, int>> &stays) const
+    {
+        OfflineComparison comparison;
+        comparison.requests = static_cast<int>(stays.size());
+        std::vector<std::string> offline = Fork()->BookOffline(stays);
+        std::unique_ptr<Hotel> online = Fork();
+        for (size_t i = 0; i < stays.size(); ++i)
+        {
+            const long long nights = stays[i].second - stays[i].first + 1;
+            if (offline[i] == "Accept")
+            {
+                ++comparison.offlineAccepted;
+                comparison.offlineNights += nights;
+            }
+            if (online->Book_V3(stays[i].first, stays[i].second) == "Accept")
+            {
+                ++comparison.onlineAccepted;
+                comparison.onlineNights += nights;
+            }
+        }
+        return comparison;
+    }
+
+    /**
+     * @brief Batched bitset booking: evaluates many pending requests in a single pass over the rooms.
+     *
+     * Requests are grouped by period. Each room's occupancy is loaded once and tested against the
+     * mask of every period, keeping a short ranked list of candidates per period (best first under
+     * the policy, lowest room number on ties), as long as the number of batch requests that can
+     * take rooms from it. Decisions are then resolved in arrival order. Only rooms booked earlier
+     * in the batch can have changed since a list was built, so a request takes the first list entry
+     * not booked since then, after re-scoring just the booked rooms. A list is rebuilt with a full
+     * scan only in the rare case that every entry was taken and no re-scored room beats the rooms
+     * left out of it. The outcome is identical to calling Book_V3 for each request in order.
+     *
+     * @tparam Policy Room-selection policy (default: most utilized)
+     * @param requests Pending (start, end) pairs in arrival order
+     * @return "Accept" or "Decline" for each request, in the same order
+     */
+    template <typename Policy = MostUtilizedPolicy>
+    std::vector<std::string> BookBatch(const std::vector<std::pair<int, int>> &requests)
+    {
+        const int k = static_cast<int>(requests.size());
+        std::vector<std::string> results(k, "Decline");
+        using RoomInfo = std::pair<int, int>; // (policy score, -room number)
+        struct PeriodCandidates
+        {
+            int start = 0;
+            int end = 0;
+            Bitset mask;
+            int limit = 0;               // Maximum list length
+            std::vector<RoomInfo> ranked; // Best first
+            size_t next = 0;             // First entry that may not be booked yet
+            size_t builtAt = 0;          // Length of the booking log when the list was built
+        };
+
+        // Group the valid requests by period
+        std::vector<int> periodOf(k, -1);
+        std::vector<PeriodCandidates> periods;
+        {
+            std::vector<int> order;
+            for (int i = 0; i < k; ++i)
+            {
+                if (requests[i].first >= 0 && requests[i].second < MaxDays && requests[i].first <= requests[i].second)
+                    order.push_back(i);
+            }
+            std::stable_sort(order.begin(), order.end(), [&requests](int a, int b)
+                             { return requests[a] < requests[b]; });
+            for (size_t n = 0; n < order.size(); ++n)
+            {
+                if (n == 0 || requests[order[n]] != requests[order[n - 1]])
+                {
+                    PeriodCandidates period;
+                    period.start = requests[order[n]].first;
+                    period.end = requests[order[n]].second;
+                    period.mask = RangeMask(period.start, period.end);
+                    periods.push_back(period);
+                }
+                periodOf[order[n]] = static_cast<int>(periods.size()) - 1;
+            }
+        }
+
+        // A list entry can only be lost to a batch request overlapping the period, so one entry per
+        // such request (plus one) means the list is almost never exhausted
+        std::vector<int> startsUpTo(MaxDays + 1, 0); // startsUpTo[d + 1]: requests starting on or before d
+        std::vector<int> endsBefore(MaxDays + 1, 0); // endsBefore[d]: requests ending before d
+        int valid = 0;
+        for (int i = 0; i < k; ++i)
+        {
+            if (periodOf[i] == -1)
+                continue;
+            ++valid;
+            ++startsUpTo[requests[i].first + 1];
+            ++endsBefore[requests[i].second + 1];
+        }
+        for (int d = 0; d < MaxDays; ++d)
+        {
+            startsUpTo[d + 1] += startsUpTo[d];
+            endsBefore[d + 1] += endsBefore[d];
+        }
+        for (PeriodCandidates &period : periods)
+        {
+            const int overlapping = startsUpTo[period.end + 1] - endsBefore[period.start];
+            period.limit = std::min({size, MaxBatchCandidates, overlapping + 1});
+        }
+
+        // Keeps a period's list sorted best first and no longer than its limit
+        auto offer = [](PeriodCandidates &period, const RoomInfo &room)
+        {
+            if (static_cast<int>(period.ranked.size()) == period.limit && !(room > period.ranked.back()))
+                return;
+            period.ranked.insert(std::upper_bound(period.ranked.begin(), period.ranked.end(), room, std::greater<RoomInfo>()), room);
+            if (static_cast<int>(period.ranked.size()) > period.limit)
+                period.ranked.pop_back();
+        };
+
+        // Single pass: one load of each room's occupancy serves every period in the batch
+        for (int r = 0; r < size; ++r)
+        {
+            const Bitset occupied = occupied_bs[r];
+            for (PeriodCandidates &period : periods)
+            {
+                if ((Policy::TakeFirst && static_cast<int>(period.ranked.size()) == period.limit) || (occupied & period.mask).any())
+                    continue;
+                offer(period, {score_bs<Policy>(r, period.start, period.end), -r});
+            }
+        }
+
+        // Resolve in arrival order; rooms booked earlier in the batch need a re-check
+        std::vector<int> bookedLog;                // Rooms in booking order
+        std::vector<size_t> lastBooked(size, 0);   // 1 + position in bookedLog of each room's last booking
+        std::vector<int> rescoredFor(size, -1);
+        for (int i = 0; i < k; ++i)
+        {
+            if (periodOf[i] == -1)
+                continue;
+            PeriodCandidates &period = periods[periodOf[i]];
+            auto bookedSinceBuilt = [&](int room)
+            { return lastBooked[room] > period.builtAt; };
+
+            // Best room among those booked since the list was built, with their current state
+            RoomInfo bestBooked(0, 0);
+            bool haveBooked = false;
+            for (size_t n = period.builtAt; n < bookedLog.size(); ++n)
+            {
+                int t = bookedLog[n];
+                if (rescoredFor[t] == i || (occupied_bs[t] & period.mask).any())
+                    continue;
+                rescoredFor[t] = i;
+                RoomInfo room(score_bs<Policy>(t, period.start, period.end), -t);
+                if (!haveBooked || room > bestBooked)
+                {
+                    bestBooked = room;
+                    haveBooked = true;
+                }
+            }
+
+            // Best room among the rest: the first list entry not booked since the list was built
+            while (period.next < period.ranked.size() && bookedSinceBuilt(-period.ranked[period.next].second))
+                ++period.next;
+            if (period.next == period.ranked.size() && static_cast<int>(period.ranked.size()) == period.limit &&
+                !(haveBooked && bestBooked > period.ranked.back()))
+            {
+                // Rooms left out of the list might now be best: rebuild it from the current state
+                period.ranked.clear();
+                period.next = 0;
+                period.builtAt = bookedLog.size();
+                haveBooked = false;
+                for (int r = 0; r < size; ++r)
+                {
+                    if ((Policy::TakeFirst && static_cast<int>(period.ranked.size()) == period.limit) || (occupied_bs[r] & period.mask).any())
+                        continue;
+                    offer(period, {score_bs<Policy>(r, period.start, period.end), -r});
+                }
+            }
+
+            int chosenRoom = -1;
+            if (period.next < period.ranked.size())
+                chosenRoom = -period.ranked[period.next].second;
+            if (haveBooked && (chosenRoom == -1 || bestBooked > period.ranked[period.next]))
+                chosenRoom = -bestBooked.second;
+            if (chosenRoom == -1)
+                continue;
+            commit_bs(chosenRoom, period.start, period.end);
+            bookedLog.push_back(chosenRoom);
+            lastBooked[chosenRoom] = bookedLog.size();
+            results[i] = "Accept";
+        }
+        return results;
+    }
+};
+
+/**
+ * @brief Outcome of replaying a booking trace under one selection policy.
+ */
+struct PolicyReport
+{
+    std::string policy;          ///< Policy name
+    int requests = 0;            ///< Number of requests replayed
+    int accepted = 0;            ///< Number of accepted requests
+    long long revenueNights = 0; ///< Total nights of accepted stays
+    double seconds = 0.0;        ///< Wall time spent replaying
+
+    double AcceptanceRate() const { return requests == 0 ? 0.0 : static_cast<double>(accepted) / requests; }
+    double Throughput() const { return seconds <= 0.0 ? 0.0 : requests / seconds; }
+};
+
+/**
+ * @brief Replays a booking trace through Book_V3 under one selection policy.
+ * @tparam Policy Room-selection policy
+ * @param hotel Hotel to book into
+ * @param trace (start, end) requests in arrival order
+ * @param report Report to fill in
+ */
+template <typename Policy>
+void ReplayTrace(Hotel &hotel, const std::vector<std::pair<int, int>> &trace, PolicyReport &report)
+{
+    report.policy = Policy::Name();
+    auto begin = std::chrono::steady_clock::now();
+    for (const auto &request : trace)
+    {
+        ++report.requests;
+        if (hotel.Book_V3<Policy>(request.first, request.second) == "Accept")
+        {
+            ++report.accepted;
+            report.revenueNights += request.second - request.first + 1;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    report.seconds = elapsed.count();
+}
+
+/**
+ * @brief Replays one booking trace against several selection policies in parallel.
+ *
+ * Every policy starts from its own Fork() of the initial hotel and runs on its own thread, so the
+ * live state is never modified. Each replay is compiled for its policy, so it runs at full speed.
+ *
+ * @tparam Policies Policies to compare
+ * @param initial Hotel state to start from
+ * @param trace (start, end) requests in arrival order
+ * @return One report per policy, in the same order
+ */
+template <typename... Policies>
+std::vector<PolicyReport> EvaluatePolicies(const Hotel &initial, const std::vector<std::pair<int, int>> &trace)
+{
+    std::vector<PolicyReport> reports(sizeof...(Policies));
+    std::vector<std::unique_ptr<Hotel>> branches;
+    for (size_t i = 0; i < reports.size(); ++i)
+    {
+        branches.push_back(initial.Fork());
+    }
+
+    std::vector<std::thread> workers;
+    size_t next = 0;
+    // Expands to one worker thread per policy, in template argument order
+    int expand[] = {0, (workers.emplace_back(ReplayTrace<Policies>, std::ref(*branches[next]), std::cref(trace),
+                                             std::ref(reports[next])),
+                        ++next, 0)...};
+    (void)expand;
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    return reports;
+}
+
+/**
+ * @brief Prints a comparison table for policy reports.
+ */
+void PrintPolicyReports(const std::vector<PolicyReport> &reports)
+{
+    for (const PolicyReport &report : reports)
+    {
+        std::cout << report.policy << ": accepted " << report.accepted << "/" << report.requests
+                  << " (" << report.AcceptanceRate() * 100.0 << "%), revenue-nights " << report.revenueNights
+                  << ", throughput " << report.Throughput() << " req/s" << std::endl;
+    }
+}
+
+/**
+ * @brief Book_V3 under a selection policy, as a booking engine for ShadowHotel.
+ *
+ * A booking engine books [start, end] into a hotel through Book() and reports the room it chose,
+ * so ShadowHotel can drive the production engine and a candidate the same way.
+ */
+template <typename Policy = MostUtilizedPolicy>
+struct BitsetEngine
+{
+    static std::string Name() { return std::string("Book_V3/") + Policy::Name(); }
+    static std::string Book(Hotel &hotel, int start, int end, int &room)
+    {
+        int id = -1;
+        std::string result = hotel.Book_V3<Policy>(start, end, &id);
+        room = result == "Accept" ? hotel.GetBooking(id).room : -1;
+        return result;
+    }
+};
+
+/**
+ * @brief One request as handled by the primary and the candidate engine of a ShadowHotel.
+ */
+struct ShadowRecord
+{
+    long long request = 0;        ///< Sequence number of the request
+    int start = 0;                ///< Start day (inclusive)
+    int end = 0;                  ///< End day (inclusive)
+    bool primaryAccepted = false; ///< Decision of the primary engine
+    int primaryRoom = -1;         ///< Room chosen by the primary engine, -1 if declined
+    long long primaryNanos = 0;   ///< Time the primary engine took
+    bool candidateAccepted = false; ///< Decision of the candidate engine
+    int candidateRoom = -1;       ///< Room chosen by the candidate engine, -1 if declined
+    long long candidateNanos = 0; ///< Time the candidate engine took
+
+    bool Diverged() const { return primaryAccepted != candidateAccepted || primaryRoom != candidateRoom; }
+    long long LatencyDelta() const { return candidateNanos - primaryNanos; }
+};
+
+/**
+ * @class ShadowHotel
+ * @brief Runs a candidate booking engine in shadow mode next to the production engine.
+ *
+ * Every request is answered by the primary engine on the live hotel, then handed through a
+ * lock-free queue to a side thread that replays it with the candidate engine on a fork of the
+ * hotel taken at construction. The side thread compares the decisions and rooms and publishes a
+ * ShadowRecord (including both latencies) through a second lock-free ring buffer. The primary
+ * never waits for the candidate: if either queue is full the request or record is dropped and
+ * counted. Only requests made through this wrapper are mirrored, and once a request is dropped
+ * the two states may legitimately differ. While the queue is empty the side thread sleeps on a
+ * condition variable; the primary only touches it when the side thread has announced it is idle.
+ *
+ * @tparam CandidateEngine Engine under evaluation (e.g. BitsetEngine<BestFitGapPolicy>)
+ * @tparam PrimaryEngine Production engine (default: Book_V3 with the most-utilized rule)
+ */
+template <typename CandidateEngine, typename PrimaryEngine = BitsetEngine<>>
+class ShadowHotel
+{
+public:
+    /**
+     * @brief Starts shadowing a hotel.
+     * @param hotel Live hotel, booked by the primary engine
+     * @param capacity Capacity of each queue
+     */
+    explicit ShadowHotel(Hotel &hotel, std::size_t capacity = 4096)
+        : primary(hotel),
+          candidate(hotel.Fork()),
+          requests(capacity),
+          records(capacity),
+          submitted(0),
+          processed(0),
+          diverged(0),
+          droppedRequests(0),
+          droppedRecords(0),
+          stopping(false),
+          idle(false),
+          worker(&ShadowHotel::run, this) {}
+
+    ShadowHotel(const ShadowHotel &) = delete;
+    ShadowHotel &operator=(const ShadowHotel &) = delete;
+
+    /**
+     * @brief Stops the side thread once it has replayed every queued request.
+     */
+    ~ShadowHotel()
+    {
+        stopping = true;
+        wakeWorker();
+        worker.join();
+    }
+
+    /**
+     * @brief Books through the primary engine and queues the request for the candidate.
+     *
+     * Call from a single thread.
+     *
+     * @param start Start day (inclusive)
+     * @param end End day (inclusive)
+     * @param room If not null, receives the room chosen by the primary engine (-1 if declined)
+     * @return The primary engine's decision
+     */
+    std::string Book(int start, int end, int *room = nullptr)
+    {
+        ShadowRecord record;
+        record.request = submitted.load(std::memory_order_relaxed) + droppedRequests.load(std::memory_order_relaxed);
+        record.start = start;
+        record.end = end;
+        const auto begin = std::chrono::steady_clock::now();
+        std::string result = PrimaryEngine::Book(primary, start, end, record.primaryRoom);
+        record.primaryNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+        record.primaryAccepted = result == "Accept";
+        if (requests.TryPush(record))
+        {
+            ++submitted;
+            if (idle.load())
+                wakeWorker();
+        }
+        else
+            ++droppedRequests;
+        if (room)
+            *room = record.primaryRoom;
+        return result;
+    }
+
+    /**
+     * @brief Takes the next comparison record. Call from a single consumer thread.
+     * @param record Receives the record
+     * @return False if no record is waiting
+     */
+    bool PollRecord(ShadowRecord &record)
+    {
+        return records.TryPop(record);
+    }
+
+    /**
+     * @brief Waits until the candidate has replayed every request queued so far.
+     */
+    void Drain() const
+    {
+        while (processed.load() < submitted.load())
+            std::this_thread::yield();
+    }
+
+    /**
+     * @brief Returns the number of requests the candidate has replayed.
+     */
+    long long Compared() const { return processed.load(); }
+
+    /**
+     * @brief Returns the number of replayed requests whose decision or room differed.
+     */
+    long long Diverged() const { return diverged.load(); }
+
+    /**
+     * @brief Returns the number of requests not replayed because the side thread fell behind.
+     */
+    long long DroppedRequests() const { return droppedRequests.load(); }
+
+    /**
+     * @brief Returns the number of records dropped because the consumer fell behind.
+     */
+    long long DroppedRecords() const { return droppedRecords.load(); }
+
+private:
+    /**
+     * @brief Wakes the side thread. Taking the mutex first means a notify cannot slip in between
+     *        the side thread's last look at the queue and its wait.
+     */
+    void wakeWorker()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+        }
+        wake.notify_one();
+    }
+
+    /**
+     * @brief Side thread: replays queued requests with the candidate engine until stopped
+     */
+    void run()
+    {
+        ShadowRecord record;
+        for (;;)
+        {
+            if (!requests.TryPop(record))
+            {
+                if (stopping.load())
+                    break;
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                idle = true;
+                // The timeout only bounds the sleep; every push made while idle notifies.
+                wake.wait_for(lock, std::chrono::milliseconds(50), [this]
+                              { return stopping.load() || submitted.load() != processed.load(); });
+                idle = false;
+                continue;
+            }
+            const auto begin = std::chrono::steady_clock::now();
+            std::string result = CandidateEngine::Book(*candidate, record.start, record.end, record.candidateRoom);
+            record.candidateNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+            record.candidateAccepted = result == "Accept";
+            if (record.Diverged())
+                ++diverged;
+            if (!records.TryPush(record))
+                ++droppedRecords;
+            ++processed;
+        }
+    }
+
+    Hotel &primary;                         ///< Live hotel (primary engine)
+    std::unique_ptr<Hotel> candidate;       ///< Fork replayed by the candidate engine
+    SpscQueue<ShadowRecord> requests;       ///< Primary thread to side thread
+    SpscQueue<ShadowRecord> records;        ///< Side thread to consumer
+    std::atomic<long long> submitted;       ///< Requests queued for the candidate
+    std::atomic<long long> processed;       ///< Requests replayed by the candidate
+    std::atomic<long long> diverged;        ///< Replayed requests that differed
+    std::atomic<long long> droppedRequests; ///< Requests the side thread never saw
+    std::atomic<long long> droppedRecords;  ///< Records the consumer never saw
+    std::atomic<bool> stopping;             ///< Set by the destructor
+    std::mutex wakeMutex;                   ///< Guards the side thread's sleep
+    std::condition_variable wake;           ///< Signalled when work arrives while idle
+    std::atomic<bool> idle;                 ///< Side thread is (about to be) asleep
+    std::thread worker;                     ///< Side thread (declared last so it starts after the rest)
+};
+
+void RunTest(const std::string &testName, int size, const std::vector<std::tuple<int, int, std::string>> &bookings)
+{
+    std::cout << "Running " << testName << " (Size=" << size << ")" << std::endl;
+    Hotel hotel(size);
+    int bookingNum = 1;
+    bool passed = true;
+    for (const auto &booking : bookings)
+    {
+        int start = std::get<0>(booking);
+        int end = std::get<1>(booking);
+        std::string expected = std::get<2>(booking);
+        std::string result = hotel.Book_V3(start, end);
+        std::cout << "Booking " << bookingNum << ": " << start << "-" << end << " " << result << " (expected: " << expected << ")" << std::endl;
+        if (result != expected)
+        {
+            std::cout << "FAIL: Expected " << expected << " but got " << result << std::endl;
+            passed = false;
+        }
+        ++bookingNum;
+    }
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunBatchTest(const std::string &testName, int size, const std::vector<std::tuple<int, int, std::string>> &bookings)
+{
+    std::cout << "Running " << testName << " (Size=" << size << ", batched)" << std::endl;
+    Hotel hotel(size);
+    std::vector<std::pair<int, int>> requests;
+    for (const auto &booking : bookings)
+    {
+        requests.push_back({std::get<0>(booking), std::get<1>(booking)});
+    }
+    std::vector<std::string> results = hotel.BookBatch(requests);
+    bool passed = true;
+    for (size_t i = 0; i < bookings.size(); ++i)
+    {
+        std::string expected = std::get<2>(bookings[i]);
+        std::cout << "Booking " << i + 1 << ": " << requests[i].first << "-" << requests[i].second << " " << results[i] << " (expected: " << expected << ")" << std::endl;
+        if (results[i] != expected)
+        {
+            std::cout << "FAIL: Expected " << expected << " but got " << results[i] << std::endl;
+            passed = false;
+        }
+    }
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunForkTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=2, forked)" << std::endl;
+    Hotel hotel(2);
+    hotel.Book_V3(0, 9);
+    std::unique_ptr<Hotel> branch = hotel.Fork();
+    std::string branchFirst = branch->Book_V3(0, 9);
+    std::string branchSecond = branch->Book_V3(0, 9);
+    std::string original = hotel.Book_V3(0, 9);
+    std::cout << "Branch: " << branchFirst << ", " << branchSecond << " (expected: Accept, Decline)" << std::endl;
+    std::cout << "Original: " << original << " (expected: Accept)" << std::endl;
+    if (branchFirst == "Accept" && branchSecond == "Decline" && original == "Accept")
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Branch bookings leaked into the original hotel" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunPolicyTest(const std::string &testName, int size, const std::vector<std::pair<int, int>> &trace,
+                   const std::vector<std::pair<int, int>> &expected)
+{
+    std::cout << "Running " << testName << " (Size=" << size << ", all policies)" << std::endl;
+    Hotel hotel(size);
+    std::vector<PolicyReport> reports =
+        EvaluatePolicies<MostUtilizedPolicy, LeastUtilizedPolicy, BestFitGapPolicy, FirstFitPolicy>(hotel, trace);
+    PrintPolicyReports(reports);
+    bool passed = true;
+    for (size_t i = 0; i < reports.size(); ++i)
+    {
+        if (reports[i].accepted != expected[i].first || reports[i].revenueNights != expected[i].second)
+        {
+            std::cout << "FAIL: Expected " << expected[i].first << " accepted and " << expected[i].second << " revenue-nights for "
+                      << reports[i].policy << " but got " << reports[i].accepted << " and " << reports[i].revenueNights << std::endl;
+            passed = false;
+        }
+    }
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunRepairTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=2, repair)" << std::endl;
+    Hotel hotel(2);
+    int moved = -1;
+    hotel.Book_V3(3, 5);
+    hotel.Book_V3(8, 8, &moved);
+    hotel.Book_V3(4, 7);
+    hotel.Book_V3(2, 3);
+    std::string plain = hotel.Fork()->Book_V3(7, 10);
+    std::string repaired = hotel.BookWithRepair(7, 10, 1, std::chrono::microseconds(1000));
+    std::cout << "Booking 7-10: " << plain << " without repair, " << repaired << " with repair (expected: Decline, Accept)" << std::endl;
+    std::cout << "Booking 8-8 moved to room " << hotel.GetBooking(moved).room << " (expected: 1)" << std::endl;
+
+    // Rooms 0 and 1 can both be cleared for 4-7 by moving one booking to room 2; the policy picks
+    Hotel twoWays(3);
+    twoWays.BulkLoad({{0, 5, 6, true}, {0, 10, 12, true}, {1, 5, 6, true}, {1, 20, 40, true}, {2, 3, 4, true}, {2, 7, 8, true}});
+    int mostId = -1, leastId = -1, gapId = -1;
+    std::unique_ptr<Hotel> most = twoWays.Fork(), least = twoWays.Fork(), gap = twoWays.Fork();
+    most->BookWithRepair<MostUtilizedPolicy>(4, 7, 1, std::chrono::microseconds(100000), &mostId);
+    least->BookWithRepair<LeastUtilizedPolicy>(4, 7, 1, std::chrono::microseconds(100000), &leastId);
+    gap->BookWithRepair<BestFitGapPolicy>(4, 7, 1, std::chrono::microseconds(100000), &gapId);
+    const int mostRoom = mostId < 0 ? -1 : most->GetBooking(mostId).room;
+    const int leastRoom = leastId < 0 ? -1 : least->GetBooking(leastId).room;
+    const int gapRoom = gapId < 0 ? -1 : gap->GetBooking(gapId).room;
+    std::cout << "Repaired 4-7 lands in room " << mostRoom << " (most utilized), " << leastRoom << " (least utilized), " << gapRoom
+              << " (best fit gap) (expected: 1, 0, 0)" << std::endl;
+    if (plain == "Decline" && repaired == "Accept" && hotel.GetBooking(moved).room == 1 && mostRoom == 1 && leastRoom == 0 &&
+        gapRoom == 0 && most->Verify().Ok() && least->Verify().Ok() && gap->Verify().Ok())
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected repair result" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunOfflineTest(const std::string &testName, int size, const std::vector<std::pair<int, int>> &stays, int expectedOffline,
+                    const std::vector<Reservation> &existing = {})
+{
+    std::cout << "Running " << testName << " (Size=" << size << ", offline, " << existing.size() << " existing bookings)" << std::endl;
+    Hotel hotel(size);
+    if (!existing.empty())
+        hotel.BulkLoad(existing);
+    OfflineComparison comparison = hotel.CompareOffline(stays);
+    std::cout << "Offline accepted " << comparison.offlineAccepted << "/" << comparison.requests
+              << " (expected: " << expectedOffline << "), online accepted " << comparison.onlineAccepted << std::endl;
+    if (comparison.offlineAccepted == expectedOffline && comparison.offlineAccepted >= comparison.onlineAccepted)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Expected " << expectedOffline << " offline accepts, at least as many as online" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunSplitStayTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=3, split stay)" << std::endl;
+    Hotel hotel(3);
+    for (const auto &booking : std::vector<std::pair<int, int>>{{6, 9}, {7, 7}, {1, 3}, {4, 6}, {3, 4}})
+    {
+        hotel.Book_V3(booking.first, booking.second);
+    }
+    std::vector<StaySegment> segments = hotel.FindSplitStay(0, 9, 2);
+    std::vector<StaySegment> tooFewMoves = hotel.FindSplitStay(0, 9, 1);
+    std::cout << "Split stay 0-9:";
+    for (const StaySegment &segment : segments)
+    {
+        std::cout << " room " << segment.room << " " << segment.start << "-" << segment.end << ";";
+    }
+    std::cout << " (expected: room 1 0-3; room 0 4-5; room 2 6-9;)" << std::endl;
+    bool passed = segments.size() == 3 && tooFewMoves.empty() &&
+                  segments[0].room == 1 && segments[0].end == 3 &&
+                  segments[1].room == 0 && segments[1].end == 5 &&
+                  segments[2].room == 2 && segments[2].end == 9;
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected split stay" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunEarliestTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=2, flexible dates)" << std::endl;
+    Hotel hotel(2);
+    hotel.Book_V3(0, 9);
+    hotel.Book_V3(3, 12);
+    hotel.Book_V3(15, 20);
+    StaySegment earliest = hotel.FindEarliest(0, 100, 4);
+    StaySegment none = hotel.FindEarliest(0, 12, 4);
+    std::cout << "Earliest 4 nights: room " << earliest.room << " " << earliest.start << "-" << earliest.end
+              << " (expected: room 0 10-13); within 0-12: room " << none.room << " (expected: -1)" << std::endl;
+    if (earliest.room == 0 && earliest.start == 10 && earliest.end == 13 && none.room == -1)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected earliest stay" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunGroupTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=4, group)" << std::endl;
+    Hotel hotel(4);
+    hotel.Book_V3(0, 1);
+    hotel.Book_V3(0, 4);
+    hotel.Book_V3(8, 9);
+    std::vector<int> ids;
+    std::string group = hotel.BookGroup(5, 7, 3, &ids);
+    std::string tooLarge = hotel.BookGroup(5, 7, 2);
+    std::cout << "Group of 3 for 5-7: " << group << " (expected: Accept); another 2: " << tooLarge << " (expected: Decline)" << std::endl;
+    bool passed = group == "Accept" && tooLarge == "Decline" && ids.size() == 3 &&
+                  hotel.GetBooking(ids[0]).room == 1 && hotel.GetBooking(ids[1]).room == 0 &&
+                  hotel.GetBooking(ids[2]).room == 2 && hotel.Book_V3(5, 7) == "Accept";
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Group did not take the three most utilized rooms" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunLayoutTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=6, group layout)" << std::endl;
+    Hotel hotel(6);
+    hotel.SetFloors({0, 0, 0, 1, 1, 1});
+    hotel.Book_V3(0, 5);
+    hotel.Book_V3(0, 5);
+    hotel.Book_V3(0, 5);
+    hotel.Book_V3(0, 5);
+    // Rooms 4 and 5 are free: both on floor 1, and consecutive
+    std::vector<int> ids;
+    std::string sameFloor = hotel.Fork()->BookGroup(2, 3, 2, GroupLayout::SameFloor);
+    std::string contiguous = hotel.BookGroup(2, 3, 2, GroupLayout::Contiguous, &ids);
+    std::string noFloor = hotel.BookGroup(4, 5, 3, GroupLayout::SameFloor);
+    std::cout << "Same floor: " << sameFloor << " (expected: Accept); contiguous: " << contiguous
+              << " (expected: Accept); 3 on one floor: " << noFloor << " (expected: Decline)" << std::endl;
+    bool passed = sameFloor == "Accept" && contiguous == "Accept" && noFloor == "Decline" &&
+                  hotel.GetBooking(ids[0]).room == 4 && hotel.GetBooking(ids[1]).room == 5;
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected layout group result" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunTypedTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Standard=2, Deluxe=1, Suite=1, typed)" << std::endl;
+    Hotel hotel({{"Standard", 2}, {"Deluxe", 1}, {"Suite", 1}});
+    std::vector<std::string> results;
+    std::vector<int> categoriesBooked;
+    int id = -1;
+    results.push_back(hotel.BookTyped(1, 0, 4, false, &id));
+    categoriesBooked.push_back(hotel.CategoryOf(hotel.GetBooking(id).room));
+    results.push_back(hotel.BookTyped(1, 2, 6));
+    results.push_back(hotel.BookTyped(1, 2, 6, true, &id));
+    categoriesBooked.push_back(hotel.CategoryOf(hotel.GetBooking(id).room));
+    results.push_back(hotel.BookTyped(1, 3, 3, true));
+    bool passed = results == std::vector<std::string>{"Accept", "Decline", "Accept", "Decline"} &&
+                  categoriesBooked == std::vector<int>{1, 2};
+    std::cout << "Deluxe 0-4: " << results[0] << ", Deluxe 2-6: " << results[1] << ", with upgrade: " << results[2]
+              << " (Suite), Deluxe 3-3 with upgrade: " << results[3] << " (expected: Accept, Decline, Accept, Decline)" << std::endl;
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected typed booking result" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunHoldTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=1, holds)" << std::endl;
+    Hotel hotel(1);
+    int first = hotel.Hold(0, 4, 900);
+    std::string whileHeld = hotel.Book_V3(2, 3);
+    std::string confirmed = hotel.Confirm(first);
+    int second = hotel.Hold(5, 9, 900);
+    hotel.AdvanceClock(899);
+    std::string beforeExpiry = hotel.Fork()->Book_V3(5, 9);
+    hotel.AdvanceClock(900);
+    std::string afterExpiry = hotel.Book_V3(5, 9);
+    std::string lateConfirm = hotel.Confirm(second);
+    std::cout << "While held: " << whileHeld << ", confirm: " << confirmed << ", before expiry: " << beforeExpiry
+              << ", after expiry: " << afterExpiry << ", late confirm: " << lateConfirm
+              << " (expected: Decline, Accept, Decline, Accept, Decline)" << std::endl;
+    if (whileHeld == "Decline" && confirmed == "Accept" && beforeExpiry == "Decline" && afterExpiry == "Accept" && lateConfirm == "Decline")
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected hold behaviour" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunWaitlistTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=1 and 3, waitlist)" << std::endl;
+    Hotel hotel(1);
+    int early = -1;
+    int late = -1;
+    hotel.Book_V3(0, 4, &early);
+    hotel.Book_V3(10, 14, &late);
+    int first = hotel.JoinWaitlist(2, 3);
+    int second = hotel.JoinWaitlist(1, 2);
+    int elsewhere = hotel.JoinWaitlist(20, 21);
+    int overlapping = hotel.JoinWaitlist(12, 12);
+    hotel.Cancel(early);
+    bool firstPromoted = !hotel.GetWaitlistEntry(first).waiting && hotel.GetWaitlistEntry(first).bookingId >= 0;
+    bool secondWaiting = hotel.GetWaitlistEntry(second).waiting;
+    bool freeBooked = !hotel.GetWaitlistEntry(elsewhere).waiting && hotel.GetWaitlistEntry(elsewhere).bookingId >= 0;
+    bool overlappingWaiting = hotel.GetWaitlistEntry(overlapping).waiting;
+
+    // A repair move frees days in the room it clears, which can promote a waiting request
+    Hotel repaired(3);
+    repaired.BulkLoad({{0, 3, 9, true}, {1, 0, 12, true}, {2, 1, 2, true}, {2, 10, 11, true}, {2, 12, 12, true}});
+    int stuck = repaired.JoinWaitlist(1, 4);
+    bool stuckWaiting = repaired.GetWaitlistEntry(stuck).waiting;
+    std::string repair = repaired.BookWithRepair(8, 12, 1, std::chrono::microseconds(100000));
+    bool stuckPromoted = !repaired.GetWaitlistEntry(stuck).waiting &&
+                         repaired.GetBooking(repaired.GetWaitlistEntry(stuck).bookingId).room == 0;
+    std::cout << "After cancelling 0-4: 2-3 promoted " << firstPromoted << ", 1-2 waiting " << secondWaiting
+              << ", free 20-21 booked on joining " << freeBooked << ", 12-12 waiting " << overlappingWaiting
+              << "; repair of 8-12: " << repair << ", 1-4 promoted into the cleared room " << (stuckWaiting && stuckPromoted)
+              << " (expected: 1, 1, 1, 1; Accept, 1)" << std::endl;
+    if (firstPromoted && secondWaiting && freeBooked && overlappingWaiting && repair == "Accept" && stuckWaiting && stuckPromoted &&
+        repaired.Verify().Ok())
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected waitlist promotion" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunSubscriptionTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=2, subscriptions)" << std::endl;
+    Hotel hotel(2);
+    bool initiallyAvailable = false;
+    int watched = hotel.Subscribe(5, 6, &initiallyAvailable);
+    hotel.Subscribe(30, 31);
+    int last = -1;
+    hotel.Book_V3(0, 5);
+    hotel.Book_V3(6, 9);
+    hotel.Book_V3(4, 8, &last);
+    hotel.Cancel(last);
+    std::vector<std::pair<int, bool>> received;
+    AvailabilityNotice notice;
+    while (hotel.PollNotification(notice))
+    {
+        received.push_back({notice.subscriptionId, notice.available});
+    }
+    std::cout << "Notices:";
+    for (const auto &item : received)
+    {
+        std::cout << " " << item.first << (item.second ? " available;" : " sold out;");
+    }
+    std::cout << " (expected: " << watched << " sold out; " << watched << " available;)" << std::endl;
+    if (initiallyAvailable && received == std::vector<std::pair<int, bool>>{{watched, false}, {watched, true}})
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected availability notices" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunModifyTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=2, modify)" << std::endl;
+    Hotel hotel(2);
+    int guest = -1;
+    hotel.Book_V3(0, 4, &guest);
+    hotel.Book_V3(8, 9);
+    std::string extend = hotel.Modify(guest, 0, 7);
+    int extendedRoom = hotel.GetBooking(guest).room;
+    std::string moveOut = hotel.Modify(guest, 0, 9);
+    int movedRoom = hotel.GetBooking(guest).room;
+    std::string shorten = hotel.Modify(guest, 2, 3);
+    std::string noRoom = hotel.Modify(guest, 8, 9);
+    std::cout << "Extend 0-7: " << extend << " in room " << extendedRoom << ", extend 0-9: " << moveOut << " moving to room " << movedRoom
+              << ", shorten 2-3: " << shorten << ", move to 8-9: " << noRoom
+              << " (expected: Accept in room 0, Accept moving to room 1, Accept, Accept)" << std::endl;
+    bool passed = extend == "Accept" && extendedRoom == 0 && moveOut == "Accept" && movedRoom == 1 &&
+                  shorten == "Accept" && noRoom == "Accept" && hotel.GetBooking(guest).room == 1 &&
+                  hotel.Book_V3(0, 7) == "Accept" && hotel.Book_V3(0, 7) == "Accept" && hotel.Modify(guest, 0, 9) == "Decline" &&
+                  hotel.GetBooking(guest).start == 8;
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected modify result" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunBlackoutTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=3, blackout)" << std::endl;
+    Hotel hotel(3);
+    int guest = -1;
+    hotel.Book_V3(5, 9, &guest);
+    int hold = hotel.Hold(0, 1, 10);
+    std::string overBooking = hotel.Blackout(0, 2, 0, 9);
+    std::vector<int> heldConflicts;
+    std::vector<int> conflicts = hotel.BlackoutConflicts(0, 2, 0, 9, &heldConflicts);
+    hotel.Release(hold);
+    std::string closed = hotel.Blackout(1, 2, 0, 9);
+    std::string open = hotel.Book_V3(0, 3);
+    std::string full = hotel.Book_V3(0, 3);
+    Hotel::Snapshot snapshot = hotel.GetSnapshot();
+    hotel.LiftBlackout(1, 2, 0, 9);
+    std::string reopened = hotel.Book_V3(0, 3);
+    std::cout << "Blackout over booking and hold: " << overBooking << " (" << conflicts.size() << " booking, " << heldConflicts.size()
+              << " hold), blackout rooms 1-2: " << closed << ", bookings: " << open << ", " << full << ", after lifting: " << reopened
+              << " (expected: Decline (1 booking, 1 hold), Accept, Accept, Decline, Accept)" << std::endl;
+    bool passed = overBooking == "Decline" && conflicts == std::vector<int>{guest} && heldConflicts == std::vector<int>{hold} && closed == "Accept" &&
+                  open == "Accept" && full == "Decline" && reopened == "Accept" &&
+                  snapshot.Utilization(1) == 0 && snapshot.Utilization(2) == 0 && snapshot.CountAvailable(0, 9) == 0;
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected blackout result" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunResizeTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=1, add and retire rooms)" << std::endl;
+    Hotel hotel(1);
+    bool available = true;
+    int subscription = hotel.Subscribe(0, 5, &available);
+    hotel.Book_V3(0, 5);
+    int waiting = hotel.JoinWaitlist(2, 3);
+    int first = hotel.AddRooms(2);
+    AvailabilityNotice notice = {-1, false};
+    std::vector<AvailabilityNotice> notices;
+    while (hotel.PollNotification(notice))
+        notices.push_back(notice);
+    std::string retireBooked = hotel.RetireRoom(0);
+    std::string retireFree = hotel.RetireRoom(2);
+    std::string soldOut = hotel.Book_V3(0, 5);
+    hotel.LiftBlackout(0, 2, 0, 365);
+    Hotel::Snapshot snapshot = hotel.GetSnapshot();
+    std::cout << "First new room: " << first << ", waitlist promoted: " << (hotel.GetWaitlistEntry(waiting).bookingId != -1)
+              << ", retire booked room: " << retireBooked << ", retire free room: " << retireFree << ", book 0-5: " << soldOut
+              << " (expected: 1, 1, Decline, Accept, Decline)" << std::endl;
+    bool passed = first == 1 && snapshot.Size() == 3 && hotel.CategoryOf(2) == 0 &&
+                  !hotel.GetWaitlistEntry(waiting).waiting && hotel.GetWaitlistEntry(waiting).bookingId != -1 &&
+                  notices.size() == 2 && notices[1].subscriptionId == subscription && notices[1].available &&
+                  retireBooked == "Decline" && retireFree == "Accept" && soldOut == "Decline" &&
+                  hotel.IsRetired(2) && snapshot.CountAvailable(10, 20) == 2;
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected resize result" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunBulkLoadTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=3, bulk load)" << std::endl;
+    Hotel hotel(3);
+    bool available = false;
+    hotel.Subscribe(0, 3, &available);
+    int firstId = -1;
+    std::string loaded = hotel.BulkLoad({{0, 0, 3, true}, {1, 0, 5, true}, {2, 1, 2, true}, {0, 5, 9, true}}, &firstId);
+    std::string overlap = hotel.BulkLoad({{2, 2, 4, true}});
+    Hotel::Snapshot snapshot = hotel.GetSnapshot();
+    AvailabilityNotice notice = {-1, true};
+    bool soldOut = hotel.PollNotification(notice) && !notice.available;
+    std::cout << "Load: " << loaded << ", overlapping load: " << overlap << ", utilization: " << snapshot.Utilization(0) << " "
+              << snapshot.Utilization(1) << " " << snapshot.Utilization(2) << " (expected: Accept, Decline, 9 6 2)" << std::endl;
+    bool passed = loaded == "Accept" && overlap == "Decline" && firstId == 0 && available && soldOut &&
+                  snapshot.Utilization(0) == 9 && snapshot.Utilization(1) == 6 && snapshot.Utilization(2) == 2 &&
+                  hotel.GetBooking(3).room == 0 && hotel.GetBooking(3).start == 5 &&
+                  hotel.Book_V3(3, 4) == "Accept" && snapshot.CountAvailable(3, 4) == 1;
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected bulk load result" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunShadowTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=3, shadow mode)" << std::endl;
+    const std::vector<std::pair<int, int>> trace = {{1, 3}, {0, 15}, {1, 9}, {2, 5}, {4, 9}, {20, 30}, {25, 26}};
+    Hotel same(3);
+    Hotel spread(3);
+    long long sameDiverged = 0;
+    long long spreadDiverged = 0;
+    long long records = 0;
+    {
+        ShadowHotel<BitsetEngine<MostUtilizedPolicy>> shadow(same);
+        for (const auto &request : trace)
+            shadow.Book(request.first, request.second);
+        shadow.Drain();
+        sameDiverged = shadow.Diverged();
+        ShadowRecord record;
+        while (shadow.PollRecord(record))
+            ++records;
+    }
+    {
+        ShadowHotel<BitsetEngine<LeastUtilizedPolicy>> shadow(spread);
+        for (const auto &request : trace)
+            shadow.Book(request.first, request.second);
+        shadow.Drain();
+        spreadDiverged = shadow.Diverged();
+    }
+    std::cout << "Same engine diverged on " << sameDiverged << " of " << records << " requests, least utilized diverged on "
+              << spreadDiverged << " (expected: 0 of 7, at least 1)" << std::endl;
+    bool passed = sameDiverged == 0 && records == static_cast<long long>(trace.size()) && spreadDiverged > 0;
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected shadow result" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunEngineSwitchTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=2, engine switch)" << std::endl;
+    Hotel hotel(2);
+    hotel.Reserve(0, 4);
+    std::string toBruteForce = hotel.SwitchEngine(BookingEngine::BruteForce);
+    std::string overlap = hotel.Reserve(2, 3);
+    std::string after = hotel.Reserve(5, 9);
+    std::string toHeap = hotel.SwitchEngine(BookingEngine::Heap);
+    std::string toBitset = hotel.SwitchEngine(BookingEngine::Bitset);
+    Hotel::Snapshot converted = hotel.GetSnapshot();
+
+    // Background switch while the bitset engine keeps booking: the written page is converted again
+    hotel.BeginSwitchEngine(BookingEngine::BruteForce);
+    hotel.Book_V3(20, 25);
+    hotel.FinishSwitchEngine();
+    std::string first = hotel.Reserve(20, 25);
+    std::string second = hotel.Reserve(20, 25);
+    std::cout << "Switches: " << toBruteForce << ", " << toHeap << ", " << toBitset << ", utilization after converting back: "
+              << converted.Utilization(0) << " " << converted.Utilization(1) << ", 20-25 after background switch: " << first
+              << ", " << second << " (expected: Accept, Accept, Accept, 10 2, Accept, Decline)" << std::endl;
+    bool passed = toBruteForce == "Accept" && overlap == "Accept" && after == "Accept" && toHeap == "Accept" &&
+                  toBitset == "Accept" && converted.Utilization(0) == 10 && converted.Utilization(1) == 2 &&
+                  hotel.GetBooking(1).room == 1 && hotel.GetBooking(2).room == 0 && hotel.GetBooking(2).start == 5 &&
+                  first == "Accept" && second == "Decline" && hotel.ActiveEngine() == BookingEngine::BruteForce;
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected engine switch result" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunUtilizationCounterTest(const std::string &testName, int size, const std::vector<std::tuple<int, int, std::string>> &bookings)
+{
+    std::cout << "Running " << testName << " (Size=" << size << ", Book/Book_V2 counters verified)" << std::endl;
+    Hotel bruteForce(size);
+    Hotel heap(size);
+    Hotel switched(size);
+    bruteForce.SetVerifyUtilization(true);
+    heap.SetVerifyUtilization(true);
+    switched.SetVerifyUtilization(true);
+    bool passed = true;
+    size_t bookingNum = 0;
+    for (const auto &booking : bookings)
+    {
+        if (bookingNum++ == bookings.size() / 2)
+            switched.SwitchEngine(BookingEngine::Heap); // Counters rebuilt from the converted rows
+        int start = std::get<0>(booking);
+        int end = std::get<1>(booking);
+        const std::string &expected = std::get<2>(booking);
+        if (bruteForce.Book(start, end) != expected || heap.Book_V2(start, end) != expected || switched.Reserve(start, end) != expected)
+            passed = false;
+    }
+    long long mismatches = bruteForce.UtilizationMismatches() + heap.UtilizationMismatches() + switched.UtilizationMismatches();
+    std::cout << "Decisions match: " << (passed ? "yes" : "no") << ", counter mismatches: " << mismatches
+              << " (expected: yes, 0)" << std::endl;
+    if (passed && mismatches == 0)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected utilization counter result" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunVerifyTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=100, consistency check)" << std::endl;
+    Hotel hotel(100);
+    hotel.Subscribe(0, 9);
+    hotel.BulkLoad({{5, 0, 9, true}, {70, 3, 4, true}});
+    for (int i = 0; i < 150; ++i)
+        hotel.Book_V3(i % 40, i % 40 + 5);
+    int bookingId = -1;
+    hotel.Book_V3(200, 210, &bookingId);
+    hotel.Modify(bookingId, 200, 215);
+    hotel.Cancel(0);
+    hotel.Hold(300, 305, 10);
+    hotel.Blackout(90, 99, 350, 360);
+    hotel.RetireRoom(80);
+    hotel.AddRooms(30);
+    hotel.Book(0, 3);
+    hotel.JoinWaitlist(0, 9);
+    ConsistencyReport full = hotel.Verify();
+    ConsistencyReport sampled = hotel.Verify(16, 42);
+
+    // Each kind of corruption, on its own fork, must be pinned on the corrupted room
+    std::vector<std::unique_ptr<Hotel>> corrupt;
+    for (int i = 0; i < 4; ++i)
+        corrupt.push_back(hotel.Fork());
+    corrupt[0]->occupied_bs.mut(5).set(365); // Booked day with no booking in the ledger
+    ++corrupt[0]->utilization.mut(5);
+    ++corrupt[1]->utilization.mut(5); // Counter off by one
+    corrupt[2]->roomBookings.mut(5).pop_back(); // Booking dropped from its room's list
+    corrupt[3]->held_bs.mut(90).set(355); // Held day that is also blocked
+    int detected = 0;
+    for (const auto &branch : corrupt)
+    {
+        if (branch->Verify().badRooms == std::vector<int>{branch.get() == corrupt[3].get() ? 90 : 5})
+            ++detected;
+    }
+
+    // Successive sampled checks cover different rooms, so a bad room is found by some but not all
+    int sampledHits = 0;
+    for (int i = 0; i < 50; ++i)
+    {
+        if (!corrupt[1]->Verify(16).Ok())
+            ++sampledHits;
+    }
+    std::cout << "Full check: " << full.roomsChecked << " rooms, " << full.badRooms.size() + full.globalViolations
+              << " problems; sampled check: " << sampled.roomsChecked << " rooms, " << sampled.badRooms.size()
+              << " problems; corruptions pinned: " << detected << "/4; sampled checks finding one bad room: " << sampledHits
+              << "/50 (expected: 130 rooms, 0 problems; 16 rooms, 0 problems; 4/4; between 1 and 49)" << std::endl;
+    bool passed = full.Ok() && full.roomsChecked == 130 && sampled.Ok() && sampled.roomsChecked == 16 && detected == 4 &&
+                  sampledHits > 0 && sampledHits < 50;
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected consistency check result" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunEngineMirrorTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (bitset-side changes under Book/Book_V2)" << std::endl;
+
+    // A booking cancelled while Book is active stays cancelled after switching back
+    Hotel cancelled(1);
+    int bookingId = -1;
+    cancelled.Book_V3(0, 4, &bookingId);
+    cancelled.SwitchEngine(BookingEngine::BruteForce);
+    cancelled.Cancel(bookingId);
+    std::string rebookUnderBf = cancelled.Reserve(0, 4);
+    cancelled.Cancel(1);
+    cancelled.SwitchEngine(BookingEngine::Bitset);
+    std::string rebook = cancelled.Book_V3(0, 4);
+
+    // A hold that expires while Book is active frees its days; a live hold is not double-sold
+    Hotel held(1);
+    held.Hold(0, 4, 10);
+    held.SwitchEngine(BookingEngine::BruteForce);
+    std::string overHold = held.Reserve(2, 3);
+    held.AdvanceClock(20);
+    std::string afterExpiry = held.Reserve(0, 4);
+    int holdOverBooking = held.Hold(0, 4, 10);
+    held.SwitchEngine(BookingEngine::Bitset);
+
+    // Closed days are taken but not counted: Book picks the same room as Book_V3
+    Hotel closed(2);
+    closed.Blackout(1, 1, 100, 200);
+    closed.SwitchEngine(BookingEngine::Heap);
+    closed.Reserve(0, 4, &bookingId);
+    int room = closed.GetBooking(bookingId).room;
+
+    // A direct Book call under Book survives the next mirror of its room (here from a hold)
+    Hotel direct(1);
+    direct.SwitchEngine(BookingEngine::BruteForce);
+    std::string directBook = direct.Book(0, 4);
+    direct.Hold(10, 12, 10);
+    std::string overDirect = direct.Book_V2(2, 3);
+    std::string overDirectV3 = direct.Book_V3(1, 1);
+
+    std::cout << "Rebook after cancel: " << rebookUnderBf << ", " << rebook << "; book over hold: " << overHold
+              << ", after expiry: " << afterExpiry << ", hold over booking: " << holdOverBooking << "; room next to blackout: " << room
+              << "; direct Book: " << directBook << ", then over it after a mirror: " << overDirect << ", " << overDirectV3
+              << " (expected: Accept, Accept; Decline, Accept, -1; 0; Accept, Decline, Decline)" << std::endl;
+    bool passed = rebookUnderBf == "Accept" && rebook == "Accept" && overHold == "Decline" && afterExpiry == "Accept" &&
+                  holdOverBooking == -1 && held.GetSnapshot().Utilization(0) == 5 && room == 0 &&
+                  directBook == "Accept" && overDirect == "Decline" && overDirectV3 == "Decline" &&
+                  direct.GetSnapshot().Utilization(0) == 5 && cancelled.Verify().Ok() && held.Verify().Ok() &&
+                  closed.Verify().Ok() && direct.Verify().Ok();
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Unexpected engine mirror result" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunSnapshotTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=2 and 64, snapshot isolation)" << std::endl;
+    Hotel hotel(2);
+    int first = -1, second = -1;
+    hotel.Book_V3(0, 9, &first);
+    hotel.Book_V3(20, 29, &second);
+    Hotel::Snapshot snapshot = hotel.GetSnapshot();
+    hotel.Book_V3(40, 49);
+    hotel.Cancel(second);
+    hotel.Blackout(1, 1, 0, 9);
+    Hotel::Snapshot live = hotel.GetSnapshot();
+    std::cout << "Snapshot free rooms for 0-9, 20-29, 40-49: " << snapshot.CountAvailable(0, 9) << ", " << snapshot.CountAvailable(20, 29) << ", "
+              << snapshot.CountAvailable(40, 49) << " (expected: 1, 1, 2), live: " << live.CountAvailable(0, 9) << ", "
+              << live.CountAvailable(20, 29) << ", " << live.CountAvailable(40, 49) << " (expected: 0, 2, 1)" << std::endl;
+    bool passed = snapshot.CountAvailable(0, 9) == 1 && snapshot.CountAvailable(20, 29) == 1 && snapshot.CountAvailable(40, 49) == 2 &&
+                  snapshot.Utilization(0) == 20 && snapshot.Utilization(1) == 0 && live.CountAvailable(0, 9) == 0 &&
+                  live.CountAvailable(20, 29) == 2 && live.CountAvailable(40, 49) == 1 && live.Utilization(0) == 20;
+
+    // Readers on another thread see a frozen snapshot stay frozen and fresh snapshots only grow
+    Hotel busy(64);
+    const Hotel::Snapshot frozen = busy.GetSnapshot();
+    std::atomic<bool> done(false);
+    std::thread writer([&busy, &done]() {
+        std::mt19937 rng(7);
+        for (int i = 0; i < 4000; ++i)
+        {
+            const int start = static_cast<int>(rng() % 360);
+            busy.Book_V3(start, start + static_cast<int>(rng() % 5));
+        }
+        done = true;
+    });
+    int reads = 0, torn = 0, previous = 0;
+    while (!done || reads == 0)
+    {
+        Hotel::Snapshot current = busy.GetSnapshot();
+        int booked = 0;
+        for (int r = 0; r < current.Size(); ++r)
+            booked += current.Utilization(r);
+        if (frozen.CountAvailable(0, 365) != 64 || booked < previous)
+            ++torn;
+        previous = booked;
+        ++reads;
+    }
+    writer.join();
+    std::cout << "Concurrent reads: " << reads << ", inconsistent: " << torn << " (expected: 0 inconsistent)" << std::endl;
+    passed = passed && torn == 0 && busy.Verify().Ok();
+    if (passed)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: Snapshot changed after it was taken" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void RunBestFitGapTest(const std::string &testName)
+{
+    std::cout << "Running " << testName << " (Size=3, best-fit gap)" << std::endl;
+    // Room 1 leaves a one-day gap on each side of 64-128, across day-word boundaries; room 0 is free first
+    Hotel hotel(3);
+    hotel.BulkLoad({{0, 0, 2, true}, {1, 60, 62, true}, {1, 130, 140, true}, {2, 10, 20, true}});
+    std::unique_ptr<Hotel> first = hotel.Fork();
+    int gapId = -1, firstId = -1;
+    hotel.Book_V3<BestFitGapPolicy>(64, 128, &gapId);
+    first->Book_V3<FirstFitPolicy>(64, 128, &firstId);
+    const int gapRoom = gapId < 0 ? -1 : hotel.GetBooking(gapId).room;
+    const int firstRoom = firstId < 0 ? -1 : first->GetBooking(firstId).room;
+    std::cout << "Booking 64-128: room " << gapRoom << " (best fit gap), room " << firstRoom << " (first fit) (expected: 1, 0)" << std::endl;
+    if (gapRoom == 1 && firstRoom == 0)
+    {
+        std::cout << "PASS" << std::endl;
+    }
+    else
+    {
+        std::cout << "FAIL: BestFitGap did not take the tightest gap" << std::endl;
     }
     std::cout << std::endl;
 }
@@ -281,6 +4853,58 @@ int main()
 
     RunTest("Test 5", 2, {{1, 3, "Accept"}, {0, 4, "Accept"}, {2, 3, "Decline"}, {5, 5, "Accept"}, {4, 10, "Accept"}, {10, 10, "Accept"}, {6, 7, "Accept"}, {8, 10, "Decline"}, {8, 9, "Accept"}});
 
+    RunBatchTest("Test 6 (batch of Test 4)", 3, {{1, 3, "Accept"}, {0, 15, "Accept"}, {1, 9, "Accept"}, {2, 5, "Decline"}, {4, 9, "Accept"}});
+
+    RunBatchTest("Test 7 (batch of Test 5)", 2, {{1, 3, "Accept"}, {0, 4, "Accept"}, {2, 3, "Decline"}, {5, 5, "Accept"}, {4, 10, "Accept"}, {10, 10, "Accept"}, {6, 7, "Accept"}, {8, 10, "Decline"}, {8, 9, "Accept"}});
+
+    RunForkTest("Test 8");
+
+    RunPolicyTest("Test 9", 3, {{3, 6}, {6, 11}, {18, 22}, {12, 12}, {13, 17}, {8, 13}, {8, 12}, {1, 2}, {2, 4}, {19, 23}, {0, 5}}, {{10, 42}, {9, 37}, {11, 48}, {10, 43}});
+
+    RunRepairTest("Test 10");
+
+    RunOfflineTest("Test 11", 1, {{0, 9}, {0, 2}, {3, 5}, {6, 9}}, 3);
+
+    RunOfflineTest("Test 11b", 2, {{5, 20}, {2, 6}, {5, 9}, {10, 15}, {16, 20}, {0, 3}}, 4, {{0, 0, 4, true}, {1, 4, 30, true}});
+
+    RunSplitStayTest("Test 12");
+
+    RunEarliestTest("Test 13");
+
+    RunGroupTest("Test 14");
+
+    RunLayoutTest("Test 15");
+
+    RunTypedTest("Test 16");
+
+    RunHoldTest("Test 17");
+
+    RunWaitlistTest("Test 18");
+
+    RunSubscriptionTest("Test 19");
+
+    RunModifyTest("Test 20");
+
+    RunBlackoutTest("Test 21");
+
+    RunResizeTest("Test 22");
+
+    RunBulkLoadTest("Test 23");
+
+    RunShadowTest("Test 24");
+
+    RunEngineSwitchTest("Test 25");
+
+    RunUtilizationCounterTest("Test 26 (counters on Test 5)", 2, {{1, 3, "Accept"}, {0, 4, "Accept"}, {2, 3, "Decline"}, {5, 5, "Accept"}, {4, 10, "Accept"}, {10, 10, "Accept"}, {6, 7, "Accept"}, {8, 10, "Decline"}, {8, 9, "Accept"}});
+
+    RunVerifyTest("Test 27");
+
+    RunEngineMirrorTest("Test 28");
+
+    RunSnapshotTest("Test 29");
+
+    RunBestFitGapTest("Test 30");
+
     std::cout << "All tests completed." << std::endl;
     return 0;
 }
\ No newline at end of file